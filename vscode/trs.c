@@ -1,18 +1,171 @@
+#define _GNU_SOURCE // For accept4, open_memstream and clock_gettime
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h> // For strcasecmp
 #include <ctype.h> // For tolower
+#include <time.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdatomic.h> // For the lock-free seat change feed
+#include <errno.h>
+#include <fcntl.h> // For syncing the data directory
+#include <signal.h>
+#include <unistd.h>
+#ifdef __linux__ // The multi-session server is built on epoll; elsewhere only the console is available
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
 
 #define TRAINS 20
 #define CLASSES 5
-#define SEATS_PER_CLASS 20
+#define MAX_SEATS_PER_CLASS 78 // Seats in the largest coach layout
+#define SEAT_MASK_WORDS 2 // 64-bit words in a per-coach seat bitmap
 #define MAX_USERS 100 // Maximum number of users the system can handle
+#define SEAT_FEED_CAPACITY 256 // Seat change events buffered between consumer drains (power of two)
+#define SCHEDULER_QUEUE_DEPTH 256 // Pending requests each priority lane will admit
+#define BOOKING_LATENCY_TARGET_MS 200 // Booking queue wait above which read/report work is shed
+#define READ_REQUEST_DEADLINE_MS 2000 // Queued read/report requests older than this are shed
+#define MAX_SESSIONS 4096 // Concurrent socket sessions the server will hold
+#define SESSION_OUTPUT_CHUNK 4096 // Initial session output buffer; it grows to fit larger replies
+#define SESSION_OUTPUT_LIMIT 65536 // Pending output per session; a client this far behind is dropped
+#define SESSION_WRITE_TIMEOUT_S 30 // Sessions whose pending output stops draining this long are dropped
+#define SESSION_IDLE_TIMEOUT_S 300 // Silent sessions are closed
+#define SCHEDULER_TICK_BUDGET 64 // Requests dispatched per event-loop pass so socket I/O keeps flowing
+#define MAX_ITINERARY_LEGS 4 // Trains in one multi-train journey
+#define MAX_ITINERARY_PASSENGERS 6 // Passengers travelling together on one journey
+#define ITINERARY_COMMIT_ATTEMPTS 3 // Validate/re-read rounds before a journey booking gives up
+#define LHB_TRAINS 3 // Trains at the head of the table (Shatabdi, Rajdhani, Duronto) that run LHB coaches
 
 // Global arrays for class names and payment types
 const char* classNames[CLASSES] = {
     "Sleeper", "Chair Car", "3rd AC", "2nd AC", "1st AC"
 };
 
+// Short class codes used in compact availability listings
+const char* classCodes[CLASSES] = {
+    "SL", "CC", "3A", "2A", "1A"
+};
+
+// --- Coach Layouts ---
+
+// Berth (or seat) types passengers can ask for
+typedef enum {
+    BERTH_LOWER,
+    BERTH_MIDDLE,
+    BERTH_UPPER,
+    BERTH_SIDE_LOWER,
+    BERTH_SIDE_UPPER,
+    BERTH_WINDOW,
+    BERTH_AISLE,
+    BERTH_TYPE_COUNT
+} BerthType;
+
+const char* berthNames[BERTH_TYPE_COUNT] = {
+    "Lower", "Middle", "Upper", "Side Lower", "Side Upper", "Window", "Aisle"
+};
+
+// Codes typed at the seat prompt and shown on the seat chart
+const char* berthCodes[BERTH_TYPE_COUNT] = {
+    "L", "M", "U", "SL", "SU", "W", "A"
+};
+
+// Bit s of a coach's seat mask stands for seat s + 1. The berth masks below are constant
+// expressions built from the berth pattern of one bay: 'bay' has bit p set when position p of
+// every 'bayLength'-seat bay is of that berth type, and bits past 'seats' are always clear.
+#define BAY_BIT(bay, bayLength, seats, word, i) \
+    ((((word) * 64 + (i)) < (seats) && (((bay) >> (((word) * 64 + (i)) % (bayLength))) & 1)) ? (1ULL << (i)) : 0)
+#define BAY_BITS8(bay, bayLength, seats, word, i) \
+    (BAY_BIT(bay, bayLength, seats, word, (i)) | BAY_BIT(bay, bayLength, seats, word, (i) + 1) | \
+     BAY_BIT(bay, bayLength, seats, word, (i) + 2) | BAY_BIT(bay, bayLength, seats, word, (i) + 3) | \
+     BAY_BIT(bay, bayLength, seats, word, (i) + 4) | BAY_BIT(bay, bayLength, seats, word, (i) + 5) | \
+     BAY_BIT(bay, bayLength, seats, word, (i) + 6) | BAY_BIT(bay, bayLength, seats, word, (i) + 7))
+#define BAY_WORD(bay, bayLength, seats, word) \
+    (BAY_BITS8(bay, bayLength, seats, word, 0) | BAY_BITS8(bay, bayLength, seats, word, 8) | \
+     BAY_BITS8(bay, bayLength, seats, word, 16) | BAY_BITS8(bay, bayLength, seats, word, 24) | \
+     BAY_BITS8(bay, bayLength, seats, word, 32) | BAY_BITS8(bay, bayLength, seats, word, 40) | \
+     BAY_BITS8(bay, bayLength, seats, word, 48) | BAY_BITS8(bay, bayLength, seats, word, 56))
+#define BERTH_MASK(bay, bayLength, seats) \
+    { BAY_WORD(bay, bayLength, seats, 0), BAY_WORD(bay, bayLength, seats, 1) }
+
+// Defines the berth masks and bitmap kernels of one coach layout. SEATS is a compile-time constant
+// in every kernel, so each gets its own fixed-length, fully unrolled word loop; the L..A arguments
+// are the bay patterns of each berth type (0 when the layout has none).
+#define DEFINE_COACH_LAYOUT(name, SEATS, BAY_LENGTH, L, M, U, SL, SU, W, A) \
+    _Static_assert((SEATS) <= MAX_SEATS_PER_CLASS, #name " layout exceeds MAX_SEATS_PER_CLASS"); \
+    enum { name##Seats = (SEATS), name##BayLength = (BAY_LENGTH) }; \
+    const uint64_t name##BerthMasks[BERTH_TYPE_COUNT][SEAT_MASK_WORDS] = { \
+        BERTH_MASK(L, BAY_LENGTH, SEATS), BERTH_MASK(M, BAY_LENGTH, SEATS), \
+        BERTH_MASK(U, BAY_LENGTH, SEATS), BERTH_MASK(SL, BAY_LENGTH, SEATS), \
+        BERTH_MASK(SU, BAY_LENGTH, SEATS), BERTH_MASK(W, BAY_LENGTH, SEATS), \
+        BERTH_MASK(A, BAY_LENGTH, SEATS) \
+    }; \
+    int name##FindFree(const uint64_t freeMask[]) { \
+        for (int w = 0; w < ((SEATS) + 63) / 64; w++) { \
+            if (freeMask[w]) return w * 64 + __builtin_ctzll(freeMask[w]); \
+        } \
+        return -1; \
+    } \
+    int name##FindFreeBerth(const uint64_t freeMask[], BerthType type) { \
+        for (int w = 0; w < ((SEATS) + 63) / 64; w++) { \
+            uint64_t candidates = freeMask[w] & name##BerthMasks[type][w]; \
+            if (candidates) return w * 64 + __builtin_ctzll(candidates); \
+        } \
+        return -1; \
+    } \
+    int name##CountFree(const uint64_t freeMask[]) { \
+        int count = 0; \
+        for (int w = 0; w < ((SEATS) + 63) / 64; w++) { \
+            count += __builtin_popcountll(freeMask[w]); \
+        } \
+        return count; \
+    }
+
+//                  name       seats bay   L     M     U     SL    SU    W     A
+DEFINE_COACH_LAYOUT(sleeper,   72,   8,    0x09, 0x12, 0x24, 0x40, 0x80, 0,    0)    // L M U L M U SL SU
+DEFINE_COACH_LAYOUT(chairCar,  78,   5,    0,    0x02, 0,    0,    0,    0x11, 0x0C) // W M A | A W
+DEFINE_COACH_LAYOUT(thirdAc,   64,   8,    0x09, 0x12, 0x24, 0x40, 0x80, 0,    0)    // L M U L M U SL SU
+DEFINE_COACH_LAYOUT(secondAc,  46,   6,    0x05, 0,    0x0A, 0x10, 0x20, 0,    0)    // L U L U SL SU
+DEFINE_COACH_LAYOUT(lhbSecondAc, 54, 6,    0x05, 0,    0x0A, 0x10, 0x20, 0,    0)    // L U L U SL SU
+DEFINE_COACH_LAYOUT(firstAc,   24,   4,    0x05, 0,    0x0A, 0,    0,    0,    0)    // L U L U cabins
+
+// A coach layout and its specialized kernels. Callers fetch the layout of a coach once and use its
+// kernels for every seat operation on that coach.
+typedef struct {
+    const char *name;
+    int seatCount;
+    int bayLength;       // Seats per bay (sleeper/AC) or row (chair car), used to lay out seat charts
+    const char *berthHint; // Berth codes offered at the seat prompt
+    const uint64_t (*berthMasks)[SEAT_MASK_WORDS];
+    int (*findFree)(const uint64_t freeMask[]);
+    int (*findFreeBerth)(const uint64_t freeMask[], BerthType type);
+    int (*countFree)(const uint64_t freeMask[]);
+} CoachLayout;
+
+#define COACH_LAYOUT(name, label, hint) \
+    { label, name##Seats, name##BayLength, hint, name##BerthMasks, name##FindFree, name##FindFreeBerth, name##CountFree }
+
+// Coach layout of each class, in classNames order
+const CoachLayout coachLayouts[CLASSES] = {
+    COACH_LAYOUT(sleeper, "72-berth sleeper", "L/M/U/SL/SU"),
+    COACH_LAYOUT(chairCar, "78-seat chair car", "W/M/A"),
+    COACH_LAYOUT(thirdAc, "64-berth 3-tier AC", "L/M/U/SL/SU"),
+    COACH_LAYOUT(secondAc, "46-berth 2-tier AC", "L/U/SL/SU"),
+    COACH_LAYOUT(firstAc, "24-berth first AC", "L/U")
+};
+
+// The longer LHB body fits nine 2nd AC bays where older coaches fit fewer
+const CoachLayout lhbSecondAcLayout = COACH_LAYOUT(lhbSecondAc, "54-berth 2-tier AC (LHB)", "L/U/SL/SU");
+
+// Coach layout of one class of one train: the class's coachLayouts entry, except that the LHB
+// trains run 54-berth 2nd AC coaches.
+const CoachLayout *coachLayoutFor(int trainIndex, int classIndex) {
+    if (trainIndex < LHB_TRAINS && classIndex == 3) return &lhbSecondAcLayout; // 2nd AC
+    return &coachLayouts[classIndex];
+}
+
 // --- Structs for Data ---
 typedef struct {
     int seatNumber;
@@ -23,7 +176,11 @@ typedef struct {
 typedef struct {
     char className[20];
     int fare;
-    Seat seats[SEATS_PER_CLASS];
+    const CoachLayout *layout;
+    unsigned long version; // Bumped on every seat change; itinerary commits validate against it
+    int freeSeats; // Kept in step with the seats by every reserve/cancel/rollback
+    uint64_t freeMask[SEAT_MASK_WORDS]; // Bit s set while seat s + 1 is free
+    Seat seats[MAX_SEATS_PER_CLASS];
 } TrainClass;
 
 typedef struct {
@@ -37,6 +194,24 @@ typedef struct {
     char password_hash[50]; // Stores a simple hash of the password
 } User;
 
+// One train of a multi-train journey
+typedef struct {
+    int trainIndex;
+    int classIndex;
+    char from[50];
+    char to[50];
+    char seatChoices[MAX_ITINERARY_PASSENGERS][20]; // Each passenger's answer: seat number, berth code or 0
+    int seatIndices[MAX_ITINERARY_PASSENGERS];      // Seats chosen from those answers (-1 while unchosen)
+    unsigned long readVersion;                      // Class version the seats were chosen against
+} ItineraryLeg;
+
+typedef struct {
+    int passengerCount;
+    char passengerNames[MAX_ITINERARY_PASSENGERS][50];
+    int legCount;
+    ItineraryLeg legs[MAX_ITINERARY_LEGS];
+} Itinerary;
+
 typedef enum {
     PAYMENT_CASH,
     PAYMENT_CARD,
@@ -50,6 +225,163 @@ const char* paymentTypeNames[] = {
     "UPI"
 };
 
+// Seat change events published by the booking paths
+typedef enum {
+    SEAT_EVENT_RESERVE,
+    SEAT_EVENT_CANCEL,
+    SEAT_EVENT_ROLLBACK
+} SeatEventType;
+
+const char* seatEventNames[] = {
+    "RESERVE",
+    "CANCEL",
+    "ROLLBACK"
+};
+
+typedef struct {
+    SeatEventType type;
+    int trainIndex;
+    int classIndex;
+    int seatNumber;
+    char passengerName[50];
+    time_t timestamp;
+} SeatEvent;
+
+// Single-producer/single-consumer ring buffer. The booking paths only ever write a slot and bump
+// 'head'; consumers only read and bump 'tail', so neither side takes a lock or waits for the other.
+// When the ring is full the event is counted in 'dropped' instead of blocking the booking.
+typedef struct {
+    SeatEvent events[SEAT_FEED_CAPACITY];
+    atomic_size_t head;      // Next slot the publisher writes
+    atomic_size_t tail;      // Next slot the consumer reads
+    atomic_ulong published;  // Events accepted into the ring
+    atomic_ulong dropped;    // Events lost because the consumer fell behind
+    unsigned long delivered; // Events handed to consumers (consumer side only)
+} SeatFeed;
+
+SeatFeed seatFeed;
+unsigned long seatFeedDroppedReported = 0; // Drops already announced in the event log
+
+// Priority lanes of the request scheduler, highest priority first
+typedef enum {
+    LANE_BOOKING,
+    LANE_CANCEL,
+    LANE_READ,
+    LANE_COUNT
+} RequestLane;
+
+const char* laneNames[] = {
+    "Booking",
+    "Cancel",
+    "Read/Report"
+};
+
+// Upper bounds (ms) of the queue-wait histogram buckets; a final bucket holds longer waits
+#define WAIT_BUCKETS 13
+const long waitBucketLimitsMs[WAIT_BUCKETS - 1] = {
+    0, 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000
+};
+
+typedef void (*RequestHandler)(Train trains[], void *context);
+
+typedef struct {
+    RequestHandler handler;
+    RequestHandler shedHandler; // Called instead of 'handler' if the request is shed; may be NULL
+    void *context;
+    struct timespec enqueuedAt;
+} Request;
+
+// Bounded FIFO for one lane, plus the counters reported on the status screen
+typedef struct {
+    Request requests[SCHEDULER_QUEUE_DEPTH];
+    int head;
+    int count;
+    unsigned long admitted;  // Accepted into the queue
+    unsigned long rejected;  // Refused at admission (queue full or lane being shed)
+    unsigned long shed;      // Dropped from the queue after waiting too long
+    unsigned long completed; // Handed to their handler
+    long lastWaitMs;         // Queue wait of the most recently dispatched request
+    long maxWaitMs;          // Worst queue wait seen so far
+    unsigned long waitHistogram[WAIT_BUCKETS]; // Dispatched requests per waitBucketLimitsMs bucket
+} RequestQueue;
+
+RequestQueue requestQueues[LANE_COUNT];
+int bookingOverloaded = 0; // Set while the oldest queued booking has waited past BOOKING_LATENCY_TARGET_MS
+
+// Where a session is in the login/signup and booking dialogs. Each state waits for one line.
+typedef enum {
+    SESSION_AUTH_MENU,
+    SESSION_LOGIN_USERNAME,
+    SESSION_LOGIN_PASSWORD,
+    SESSION_SIGNUP_USERNAME,
+    SESSION_SIGNUP_PASSWORD,
+    SESSION_MAIN_MENU,
+    SESSION_BOOK_TRAIN,
+    SESSION_BOOK_FROM,
+    SESSION_BOOK_TO,
+    SESSION_BOOK_CLASS,
+    SESSION_BOOK_COUNT,
+    SESSION_BOOK_SEAT,
+    SESSION_BOOK_NAME,
+    SESSION_BOOK_PAYMENT,
+    SESSION_CANCEL_TRAIN,
+    SESSION_CANCEL_CLASS,
+    SESSION_CANCEL_SEAT,
+    SESSION_VIEW_TRAIN,
+    SESSION_ITIN_PASSENGERS,
+    SESSION_ITIN_NAME,
+    SESSION_ITIN_TRAIN,
+    SESSION_ITIN_FROM,
+    SESSION_ITIN_TO,
+    SESSION_ITIN_CLASS,
+    SESSION_ITIN_SEAT,
+    SESSION_ITIN_MORE,
+    SESSION_ITIN_PAYMENT,
+    SESSION_WAITING // A scheduled request for this session has not run yet
+} SessionState;
+
+// One client of the dialogs, on a socket or on the console: its buffers plus its dialog progress
+typedef struct {
+    int fd;
+    int console;          // Driven from stdin/stdout by runConsoleSession instead of a socket
+    int slot; // Index in sessions[]
+    Train *trains;
+    SessionState state;
+    int closed;           // Socket closed; kept allocated while pendingRequests > 0
+    int closeAfterFlush;  // Close once pending output is written
+    int outputOverflow;   // Client fell SESSION_OUTPUT_LIMIT behind; drop it
+    int wantsWrite;       // EPOLLOUT currently registered
+    int pendingRequests;  // Scheduled requests that still refer to this session
+    time_t lastActivity;
+    char input[256];
+    int inputLength;
+    int discardingInput;  // Skipping the rest of an over-long line up to its newline
+    char *output;         // Pending output, grown as replies need
+    size_t outputLength;
+    size_t outputCapacity;
+    time_t outputStalledSince; // When pending output last made progress (0 while drained)
+    char *streamText;     // Scratch buffer for openSessionStream
+    size_t streamLength;
+
+    // Dialog progress
+    char username[50];
+    int attemptsLeft;
+    int trainIndex;
+    int classIndex;
+    char from[50];
+    int pendingSeatIndex;
+    int paymentMethod;
+    RequestHandler viewHandler;
+    Itinerary itinerary;    // Journey being planned; a single booking is a journey of one leg
+    int itineraryPassenger; // Passenger the current name/seat prompt is for
+} Session;
+
+Session *sessions[MAX_SESSIONS];
+int sessionCount = 0;
+int nextSessionSlot = 0;
+int serverEpollFd = -1;
+volatile sig_atomic_t serverStopping = 0;
+
 // Global array for train routes (fixed data)
 const char *trainRoutes[TRAINS][10] = {
     {"New Delhi", "Tughlakabad", "Agra Cantt", "Gwalior", "Jhansi", "Bhopal", NULL},
@@ -79,35 +411,60 @@ User users[MAX_USERS];
 int userCount = 0; // Current number of registered users
 
 // --- Function Prototypes ---
-void showMenu();
-void flushInput();
 void hashPassword(const char *password, char *hashed_password);
-int login();
-int signup();
-void showLoginSignupMenu();
 void initializeTrains(Train trains[], int totalTrains);
-int selectPaymentType();
-int getClassIndex();
-void selectTrain(Train trains[], int *trainIndex);
-int findSeatIndex(int seatNumber);
+void writeTrainList(FILE *out, Train trains[]);
+int findSeatIndex(const TrainClass *trainClass, int seatNumber);
+int parseNumber(const char *line, int *value);
+BerthType berthTypeOf(const CoachLayout *layout, int seatIndex);
+int chooseSeat(const TrainClass *trainClass, const uint64_t freeMask[], const char *answer);
 int validateRoute(int trainIndex, char *from, char *to);
-void reserveSeat(Train trains[]);
-void cancelReservation(Train trains[]);
-void displayReservedSeats(Train trains[]);
-void displaySeatChart(Train trains[]);
+void occupySeat(TrainClass *trainClass, int seatIndex, const char *passengerName);
+void releaseSeat(TrainClass *trainClass, int seatIndex);
+void rebuildAvailability(Train trains[], int totalTrains);
+void publishSeatEvent(SeatEventType type, int trainIndex, int classIndex, int seatIndex, const char *passengerName);
+int pollSeatEvents(SeatEvent events[], int maxEvents);
+void drainSeatFeed(Train trains[]);
+int resolveItinerarySeat(Train trains[], Itinerary *itinerary, int legIndex, int passenger);
+int commitItinerary(Train trains[], Itinerary *itinerary);
+void writeItinerary(FILE *out, Train trains[], const Itinerary *itinerary);
+void writeReservedSeats(FILE *out, Train trains[], int trainIndex);
+void writeSeatChart(FILE *out, Train trains[], int trainIndex);
+void writeAvailability(FILE *out, Train trains[]);
+void writeSystemStatus(FILE *out);
+
+// --- Request Scheduler Functions ---
+int submitRequest(RequestLane lane, RequestHandler handler, RequestHandler shedHandler, void *context);
+int runScheduler(Train trains[], int maxRequests);
+void updateBookingOverload();
+long waitPercentileMs(const RequestQueue *queue, int percentile);
+long elapsedMs(const struct timespec *since);
+
+// --- Multi-Session Server Functions ---
+#ifdef __linux__
+int runSessionServer(Train trains[], const char *socketPath);
+#endif
+void handleSessionLine(Session *session, char *line);
+void processSessionInput(Session *session);
+void shedSessionRequest(Train trains[], void *context);
+int flushSession(Session *session);
+void closeSession(Session *session);
+void freeSession(Session *session);
+void runConsoleSession(Train trains[]);
 
 // --- Functions for Data Persistence ---
-void saveData(Train trains[]);
-void loadData(Train trains[]);
+int saveData(Train trains[]);
+int saveTrainData(Train trains[]);
+int saveUserData();
+int commitDataFile(FILE *fp, const char *tempPath, const char *path);
+int syncDataDirectory();
+int readDataLine(FILE *fp, char *line, int size, int *pending);
+int isSeatLine(const char *line);
+int loadData(Train trains[]);
 
 
 // --- Utility Functions ---
 
-void flushInput() {
-    int c;
-    while ((c = getchar()) != '\n' && c != EOF) {}
-}
-
 // A very simple XOR-based hash for demonstration. NOT for production!
 // For real applications, use secure hashing libraries (e.g., bcrypt, Argon2).
 void hashPassword(const char *password, char *hashed_password) {
@@ -118,100 +475,6 @@ void hashPassword(const char *password, char *hashed_password) {
     hashed_password[i] = '\0';
 }
 
-// Function to handle user signup (now supports multiple users)
-int signup() {
-    char newUsername[50];
-    char newPassword[50];
-    char hashed_newPassword[50];
-
-    printf("\n==== Train Reservation System Signup ====\n");
-
-    if (userCount >= MAX_USERS) {
-        printf("Maximum number of users reached. Cannot create new account.\n");
-        return 0;
-    }
-
-    printf("Enter new username: ");
-    if (fgets(newUsername, sizeof(newUsername), stdin) == NULL) {
-        return 0;
-    }
-    newUsername[strcspn(newUsername, "\n")] = '\0';
-
-    // Check if username already exists
-    for (int i = 0; i < userCount; i++) {
-        if (strcmp(newUsername, users[i].username) == 0) {
-            printf("Error: Username '%s' already taken. Please choose another.\n", newUsername);
-            return 0;
-        }
-    }
-
-    printf("Enter new password: ");
-    if (fgets(newPassword, sizeof(newPassword), stdin) == NULL) {
-        return 0;
-    }
-    newPassword[strcspn(newPassword, "\n")] = '\0';
-
-    // Store new user
-    strcpy(users[userCount].username, newUsername);
-    hashPassword(newPassword, users[userCount].password_hash);
-    userCount++;
-
-    printf("Account for '%s' created successfully!\n", newUsername);
-    return 1;
-}
-
-// Function to handle user login (now authenticates against multiple users)
-int login() {
-    char username[50];
-    char password[50];
-    char hashed_password_input[50];
-
-    if (userCount == 0) {
-        printf("\nNo accounts found. Please sign up first.\n");
-        return 0;
-    }
-
-    printf("\n==== Train Reservation System Login ====\n");
-
-    for (int attempts = 3; attempts > 0; attempts--) {
-        printf("Username: ");
-        if (fgets(username, sizeof(username), stdin) == NULL) return 0;
-        username[strcspn(username, "\n")] = '\0';
-
-        printf("Password: ");
-        if (fgets(password, sizeof(password), stdin) == NULL) return 0;
-        password[strcspn(password, "\n")] = '\0';
-
-        hashPassword(password, hashed_password_input); // Hash the input password for comparison
-
-        int loggedIn = 0;
-        for (int i = 0; i < userCount; i++) {
-            if (strcmp(username, users[i].username) == 0 && strcmp(hashed_password_input, users[i].password_hash) == 0) {
-                printf("Login successful! Welcome, %s.\n", username);
-                loggedIn = 1;
-                break;
-            }
-        }
-
-        if (loggedIn) {
-            return 1;
-        } else {
-            printf("Invalid credentials. Attempts left: %d\n", attempts - 1);
-        }
-    }
-    printf("Too many failed attempts. Exiting...\n");
-    return 0;
-}
-
-// Displays the login/signup menu
-void showLoginSignupMenu() {
-    printf("\n--- Welcome to Train Reservation System ---\n");
-    printf("1. Login\n");
-    printf("2. Sign Up\n");
-    printf("3. Exit\n");
-    printf("Enter your choice: ");
-}
-
 // Initializes train data, including class names, fares, and initial seat availability.
 // This function is called only if no saved train data is found.
 void initializeTrains(Train trains[], int totalTrains) {
@@ -232,87 +495,70 @@ void initializeTrains(Train trains[], int totalTrains) {
         strcpy(trains[i].classes[4].className, "1st AC");
         trains[i].classes[4].fare = 1000;
 
-        // All seats are initially unreserved
+        // All seats are initially unreserved. loadData has already given each class its coach layout.
         for (int c = 0; c < CLASSES; c++) {
-            for (int s = 0; s < SEATS_PER_CLASS; s++) {
+            for (int s = 0; s < trains[i].classes[c].layout->seatCount; s++) {
                 trains[i].classes[c].seats[s].seatNumber = s + 1;
                 trains[i].classes[c].seats[s].isReserved = 0;
                 trains[i].classes[c].seats[s].passengerName[0] = '\0';
             }
         }
     }
+    rebuildAvailability(trains, totalTrains);
 }
 
-// Displays the main menu options to the user.
-void showMenu() {
-    printf("\n--- Train Reservation System ---\n");
-    printf("1. Reserve Seat\n");
-    printf("2. Cancel Reservation\n");
-    printf("3. Display Seat Chart\n");
-    printf("4. Display Reserved Seats Only\n");
-    printf("5. Exit\n");
-    printf("Enter your choice: ");
+// Writes the numbered train list with live free-seat counts per class.
+void writeTrainList(FILE *out, Train trains[]) {
+    fprintf(out, "Select Train:\n");
+    for (int i = 0; i < TRAINS; i++) {
+        fprintf(out, "%2d. %-25s (%s)\n", i + 1, trains[i].trainName, trains[i].route);
+        fprintf(out, "    Free:");
+        for (int c = 0; c < CLASSES; c++) {
+            fprintf(out, " %s %2d", classCodes[c], trains[i].classes[c].freeSeats);
+        }
+        fprintf(out, "\n");
+    }
 }
 
-// Allows the user to select a payment method.
-int selectPaymentType() {
-    printf("Select Payment Method:\n");
-    for (int i = 0; i < PAYMENT_COUNT; i++) {
-        printf("%d. %s\n", i + 1, paymentTypeNames[i]);
-    }
-    printf("Enter choice: ");
-    int choice;
-    if (scanf("%d", &choice) != 1) {
-        flushInput();
-        return -1;
-    }
-    flushInput();
-    if (choice < 1 || choice > PAYMENT_COUNT) {
+// Validates a given seat number against the coach layout and returns its zero-based index.
+int findSeatIndex(const TrainClass *trainClass, int seatNumber) {
+    if (seatNumber < 1 || seatNumber > trainClass->layout->seatCount)
         return -1;
-    }
-    return choice - 1;
+    return seatNumber - 1;
 }
 
-// Gets the user's class selection and returns its zero-based index.
-int getClassIndex() {
-    printf("Select Class:\n");
-    for (int i = 0; i < CLASSES; i++) {
-        printf("%d. %s\n", i + 1, classNames[i]);
+// Returns the berth type of a seat in the given coach layout.
+BerthType berthTypeOf(const CoachLayout *layout, int seatIndex) {
+    uint64_t bit = 1ULL << (seatIndex % 64);
+    for (int type = 0; type < BERTH_TYPE_COUNT; type++) {
+        if (layout->berthMasks[type][seatIndex / 64] & bit) return type;
     }
-    printf("Enter class number: ");
-    int c;
-    if (scanf("%d", &c) != 1 || c < 1 || c > CLASSES) {
-        flushInput();
-        printf("Invalid class selection.\n");
-        return -1;
-    }
-    flushInput();
-    return c - 1;
+    return BERTH_LOWER; // Not reached: every seat of a layout has a berth type
 }
 
-// Prompts the user to select a train and stores its index.
-void selectTrain(Train trains[], int *trainIndex) {
-    printf("Select Train:\n");
-    for (int i = 0; i < TRAINS; i++) {
-        printf("%2d. %-25s (%s)\n", i + 1, trains[i].trainName, trains[i].route);
-    }
-    printf("Enter train number: ");
-    int selectedTrainNum;
-    if (scanf("%d", &selectedTrainNum) != 1 || selectedTrainNum < 1 || selectedTrainNum > TRAINS) {
-        printf("Invalid train selection.\n");
-        flushInput();
-        *trainIndex = -1;
-        return;
+// Resolves an answer to the seat prompt against a free-seat bitmap: a seat number, a berth code
+// (first free berth of that type) or 0 (first free seat). Returns the seat index, -1 for an invalid
+// answer or -2 if no free seat matches. A seat given by number may not be free; callers check that.
+int chooseSeat(const TrainClass *trainClass, const uint64_t freeMask[], const char *answer) {
+    const CoachLayout *layout = trainClass->layout;
+    int seatNumber;
+
+    if (parseNumber(answer, &seatNumber)) {
+        if (seatNumber == 0) {
+            int seatIndex = layout->findFree(freeMask);
+            return seatIndex == -1 ? -2 : seatIndex;
+        }
+        return findSeatIndex(trainClass, seatNumber); // Range-checked, so negative numbers are invalid too
     }
-    flushInput();
-    *trainIndex = selectedTrainNum - 1;
-}
 
-// Validates a given seat number and returns its zero-based index.
-int findSeatIndex(int seatNumber) {
-    if (seatNumber < 1 || seatNumber > SEATS_PER_CLASS)
-        return -1;
-    return seatNumber - 1;
+    for (int type = 0; type < BERTH_TYPE_COUNT; type++) {
+        if (strcasecmp(answer, berthCodes[type]) == 0) {
+            if (layout->berthMasks[type][0] == 0 && layout->berthMasks[type][1] == 0) return -1;
+            int seatIndex = layout->findFreeBerth(freeMask, type);
+            return seatIndex == -1 ? -2 : seatIndex;
+        }
+    }
+    return -1;
 }
 
 // Checks if boarding and destination stations are valid and in the correct order for a given train.
@@ -343,286 +589,1613 @@ int validateRoute(int trainIndex, char *from, char *to) {
     return fromIndex < toIndex;
 }
 
-// Handles the seat reservation process, including multiple seat bookings and payment.
-void reserveSeat(Train trains[]) {
-    int trainIndex;
-    selectTrain(trains, &trainIndex);
-    if (trainIndex == -1) return;
+// Marks a seat as reserved for a passenger and updates the class's free-seat counter.
+void occupySeat(TrainClass *trainClass, int seatIndex, const char *passengerName) {
+    Seat *seat = &trainClass->seats[seatIndex];
+    strncpy(seat->passengerName, passengerName, sizeof(seat->passengerName) - 1);
+    seat->passengerName[sizeof(seat->passengerName) - 1] = '\0';
+    seat->isReserved = 1;
+    trainClass->freeSeats--;
+    trainClass->version++;
+    trainClass->freeMask[seatIndex / 64] &= ~(1ULL << (seatIndex % 64));
+}
 
-    printf("\nStations for %s:\n", trains[trainIndex].trainName);
-    for (int i = 0; trainRoutes[trainIndex][i] != NULL; i++) {
-        printf("    - %s\n", trainRoutes[trainIndex][i]);
-    }
+// Frees a reserved seat and updates the class's free-seat counter.
+void releaseSeat(TrainClass *trainClass, int seatIndex) {
+    Seat *seat = &trainClass->seats[seatIndex];
+    seat->isReserved = 0;
+    seat->passengerName[0] = '\0';
+    trainClass->freeSeats++;
+    trainClass->version++;
+    trainClass->freeMask[seatIndex / 64] |= 1ULL << (seatIndex % 64);
+}
 
-    char from[50], to[50];
-    printf("\nEnter boarding station: ");
-    if (fgets(from, sizeof(from), stdin) == NULL) return;
-    from[strcspn(from, "\n")] = '\0';
+// Rebuilds the free-seat bitmap and counter of every class. Only needed after bulk changes such as
+// loading saved data; the booking paths keep both current through occupySeat/releaseSeat.
+void rebuildAvailability(Train trains[], int totalTrains) {
+    for (int i = 0; i < totalTrains; i++) {
+        for (int c = 0; c < CLASSES; c++) {
+            TrainClass *trainClass = &trains[i].classes[c];
+            memset(trainClass->freeMask, 0, sizeof(trainClass->freeMask));
+            for (int s = 0; s < trainClass->layout->seatCount; s++) {
+                if (!trainClass->seats[s].isReserved) {
+                    trainClass->freeMask[s / 64] |= 1ULL << (s % 64);
+                }
+            }
+            trainClass->freeSeats = trainClass->layout->countFree(trainClass->freeMask);
+        }
+    }
+}
 
-    printf("Enter destination station: ");
-    if (fgets(to, sizeof(to), stdin) == NULL) return;
-    to[strcspn(to, "\n")] = '\0';
+// --- Seat Change Feed ---
 
-    if (!validateRoute(trainIndex, from, to)) {
-        printf("Invalid route for this train or stations are in incorrect order. Reservation cancelled.\n");
+// Publishes a seat change into the feed. Called from the booking paths, so it only copies the event
+// into the ring; formatting and file output happen on the consumer side.
+void publishSeatEvent(SeatEventType type, int trainIndex, int classIndex, int seatIndex, const char *passengerName) {
+    size_t head = atomic_load_explicit(&seatFeed.head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&seatFeed.tail, memory_order_acquire);
+    if (head - tail >= SEAT_FEED_CAPACITY) {
+        atomic_fetch_add_explicit(&seatFeed.dropped, 1, memory_order_relaxed);
         return;
     }
 
-    int classIndex = getClassIndex();
-    if (classIndex == -1) {
-        printf("Invalid class choice.\n");
-        return;
+    SeatEvent *event = &seatFeed.events[head & (SEAT_FEED_CAPACITY - 1)];
+    event->type = type;
+    event->trainIndex = trainIndex;
+    event->classIndex = classIndex;
+    event->seatNumber = seatIndex + 1;
+    strncpy(event->passengerName, passengerName, sizeof(event->passengerName) - 1);
+    event->passengerName[sizeof(event->passengerName) - 1] = '\0';
+    event->timestamp = time(NULL);
+
+    atomic_store_explicit(&seatFeed.head, head + 1, memory_order_release);
+    atomic_fetch_add_explicit(&seatFeed.published, 1, memory_order_relaxed);
+}
+
+// Copies up to maxEvents pending events out of the feed for an in-process consumer.
+// Returns the number of events copied.
+int pollSeatEvents(SeatEvent events[], int maxEvents) {
+    size_t tail = atomic_load_explicit(&seatFeed.tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&seatFeed.head, memory_order_acquire);
+    int count = 0;
+
+    while (tail != head && count < maxEvents) {
+        events[count++] = seatFeed.events[tail & (SEAT_FEED_CAPACITY - 1)];
+        tail++;
     }
+    atomic_store_explicit(&seatFeed.tail, tail, memory_order_release);
+    seatFeed.delivered += count;
+    return count;
+}
 
-    int numSeats;
-    printf("Enter number of seats to reserve (1-%d): ", SEATS_PER_CLASS);
-    if (scanf("%d", &numSeats) != 1 || numSeats < 1 || numSeats > SEATS_PER_CLASS) {
-        flushInput();
-        printf("Invalid number of seats.\n");
+// Appends pending events to seat_events.log so displays and other services can follow it with a
+// file tail. Lines use the same '|' layout as train_data.txt:
+//   timestamp|event|train|class|seat|passenger
+// Drops are written as a '#' comment line so tail consumers know they missed events.
+// Events stay in the ring until the log is open, so a failed open shows up as drops, not as silent loss.
+void drainSeatFeed(Train trains[]) {
+    SeatEvent events[32];
+    unsigned long dropped = atomic_load_explicit(&seatFeed.dropped, memory_order_relaxed);
+    size_t pending = atomic_load_explicit(&seatFeed.head, memory_order_acquire) -
+                     atomic_load_explicit(&seatFeed.tail, memory_order_relaxed);
+    if (pending == 0 && dropped == seatFeedDroppedReported) return;
+
+    FILE *event_fp = fopen("seat_events.log", "a");
+    if (event_fp == NULL) {
+        perror("Error opening seat_events.log for writing");
         return;
     }
-    flushInput();
+    int count = pollSeatEvents(events, 32);
 
-    int selectedSeatIndices[SEATS_PER_CLASS];
-    int currentReserved = 0;
-
-    for (int i = 0; i < numSeats; i++) {
-        int seatNum;
-        printf("Enter seat number #%d (1-%d): ", i + 1, SEATS_PER_CLASS);
-        if (scanf("%d", &seatNum) != 1) {
-            flushInput();
-            printf("Invalid input. Try again.\n");
-            i--;
-            continue;
+    if (dropped != seatFeedDroppedReported) {
+        fprintf(event_fp, "# dropped %lu event(s), %lu total\n", dropped - seatFeedDroppedReported, dropped);
+        seatFeedDroppedReported = dropped;
+    }
+    do {
+        for (int i = 0; i < count; i++) {
+            SeatEvent *event = &events[i];
+            fprintf(event_fp, "%ld|%s|%s|%s|%d|%s\n", (long)event->timestamp, seatEventNames[event->type],
+                    trains[event->trainIndex].trainName, trains[event->trainIndex].classes[event->classIndex].className,
+                    event->seatNumber, event->passengerName);
         }
-        flushInput();
+    } while ((count = pollSeatEvents(events, 32)) > 0);
 
-        int seatIndex = findSeatIndex(seatNum);
-        if (seatIndex == -1) {
-            printf("Seat number out of range. Try again.\n");
-            i--;
-            continue;
-        }
+    fclose(event_fp);
+}
 
-        Seat *seat = &trains[trainIndex].classes[classIndex].seats[seatIndex];
-        if (seat->isReserved) {
-            printf("Seat %d already reserved. Choose another.\n", seatNum);
-            i--;
-            continue;
+// --- Multi-Train Itineraries ---
+
+// Resolves one passenger's seat choice on one leg. Seats the itinerary has already picked on the same
+// train and class count as taken, so two passengers or two legs never get the same seat. Returns the
+// seat index, -1 for an invalid choice, -2 if no free seat matches, -3 if the numbered seat is taken.
+int resolveItinerarySeat(Train trains[], Itinerary *itinerary, int legIndex, int passenger) {
+    ItineraryLeg *leg = &itinerary->legs[legIndex];
+    TrainClass *trainClass = &trains[leg->trainIndex].classes[leg->classIndex];
+    uint64_t freeMask[SEAT_MASK_WORDS];
+    memcpy(freeMask, trainClass->freeMask, sizeof(freeMask));
+
+    for (int l = 0; l < itinerary->legCount; l++) {
+        ItineraryLeg *other = &itinerary->legs[l];
+        if (other->trainIndex != leg->trainIndex || other->classIndex != leg->classIndex) continue;
+        for (int p = 0; p < itinerary->passengerCount; p++) {
+            int seatIndex = other->seatIndices[p];
+            if (seatIndex >= 0 && !(l == legIndex && p == passenger)) {
+                freeMask[seatIndex / 64] &= ~(1ULL << (seatIndex % 64));
+            }
         }
-
-        printf("Enter passenger name for seat %d: ", seatNum);
-        fgets(seat->passengerName, sizeof(seat->passengerName), stdin);
-        seat->passengerName[strcspn(seat->passengerName, "\n")] = '\0';
-
-        seat->isReserved = 1;
-        selectedSeatIndices[currentReserved++] = seatIndex;
     }
 
-    if (currentReserved > 0) {
-        int totalFare = currentReserved * trains[trainIndex].classes[classIndex].fare;
-        printf("Total Fare for %d seat(s): Rs.%d\n", currentReserved, totalFare);
+    int seatIndex = chooseSeat(trainClass, freeMask, leg->seatChoices[passenger]);
+    if (seatIndex >= 0 && !(freeMask[seatIndex / 64] & (1ULL << (seatIndex % 64)))) return -3;
+    return seatIndex;
+}
 
-        int paymentMethod = selectPaymentType();
-        if (paymentMethod == -1) {
-            printf("Payment failed or cancelled. Rolling back reservations.\n");
-            for (int i = 0; i < currentReserved; i++) {
-                int seatIndexToRollback = selectedSeatIndices[i];
-                Seat *seat = &trains[trainIndex].classes[classIndex].seats[seatIndexToRollback];
-                seat->isReserved = 0;
-                seat->passengerName[0] = '\0';
-            }
-            return;
-        }
+// Message for a failed resolveItinerarySeat.
+const char *seatChoiceError(int result) {
+    if (result == -2) return "No matching free seat left. Choose another.";
+    if (result == -3) return "That seat is already taken. Choose another.";
+    return "Invalid seat choice. Try again.";
+}
 
-        printf("Payment Method: %s\n", paymentTypeNames[paymentMethod]);
-        printf("Reservation successful for %d seat(s) on %s in %s class.\n",
-               currentReserved, trains[trainIndex].trainName, trains[trainIndex].classes[classIndex].className);
-        saveData(trains); // Save data after successful reservation
-    } else {
-        printf("No seats reserved.\n");
+// Total fare of every passenger on every leg.
+int itineraryFare(Train trains[], const Itinerary *itinerary) {
+    int totalFare = 0;
+    for (int l = 0; l < itinerary->legCount; l++) {
+        const ItineraryLeg *leg = &itinerary->legs[l];
+        totalFare += itinerary->passengerCount * trains[leg->trainIndex].classes[leg->classIndex].fare;
     }
+    return totalFare;
 }
 
-// Handles the cancellation of an existing reservation.
-void cancelReservation(Train trains[]) {
-    int trainIndex;
-    selectTrain(trains, &trainIndex);
-    if (trainIndex == -1) return;
+// Writes the legs and seats of an itinerary.
+void writeItinerary(FILE *out, Train trains[], const Itinerary *itinerary) {
+    fprintf(out, "\n--- Journey for %d passenger(s) ---\n", itinerary->passengerCount);
+    for (int l = 0; l < itinerary->legCount; l++) {
+        const ItineraryLeg *leg = &itinerary->legs[l];
+        const TrainClass *trainClass = &trains[leg->trainIndex].classes[leg->classIndex];
+        fprintf(out, "Leg %d: %s, %s to %s, %s class\n", l + 1, trains[leg->trainIndex].trainName,
+                leg->from, leg->to, trainClass->className);
+        for (int p = 0; p < itinerary->passengerCount; p++) {
+            int seatIndex = leg->seatIndices[p];
+            fprintf(out, "    Seat %2d %-2s: %s\n", seatIndex + 1, berthCodes[berthTypeOf(trainClass->layout, seatIndex)],
+                    itinerary->passengerNames[p]);
+        }
+    }
+}
 
-    int classIndex = getClassIndex();
-    if (classIndex == -1) return;
+// Checks that no leg's class changed since its seats were read, or that its seats are all still
+// free if it did. Returns 1 when the itinerary can be committed as it stands.
+int validateItinerary(Train trains[], Itinerary *itinerary) {
+    for (int l = 0; l < itinerary->legCount; l++) {
+        ItineraryLeg *leg = &itinerary->legs[l];
+        TrainClass *trainClass = &trains[leg->trainIndex].classes[leg->classIndex];
+        if (trainClass->version == leg->readVersion) continue;
 
-    int seatNum;
-    printf("Enter seat number to cancel (1-%d): ", SEATS_PER_CLASS);
-    if (scanf("%d", &seatNum) != 1) {
-        flushInput();
-        printf("Invalid seat number input.\n");
-        return;
+        for (int p = 0; p < itinerary->passengerCount; p++) {
+            if (trainClass->seats[leg->seatIndices[p]].isReserved) return 0;
+        }
+        leg->readVersion = trainClass->version;
     }
-    flushInput();
+    return 1;
+}
 
-    int seatIndex = findSeatIndex(seatNum);
-    if (seatIndex == -1) {
-        printf("Invalid seat number.\n");
-        return;
+// Re-reads every leg whose class changed: seats that were taken meanwhile are chosen again from the
+// passenger's original choice, so "any lower berth" finds another one while a specific seat number
+// that has gone cannot be replaced. Returns 0 if some seat could not be replaced.
+int refreshItinerary(Train trains[], Itinerary *itinerary) {
+    for (int l = 0; l < itinerary->legCount; l++) {
+        ItineraryLeg *leg = &itinerary->legs[l];
+        TrainClass *trainClass = &trains[leg->trainIndex].classes[leg->classIndex];
+        if (trainClass->version == leg->readVersion) continue;
+
+        leg->readVersion = trainClass->version;
+        for (int p = 0; p < itinerary->passengerCount; p++) {
+            if (trainClass->seats[leg->seatIndices[p]].isReserved) leg->seatIndices[p] = -1;
+        }
+        for (int p = 0; p < itinerary->passengerCount; p++) {
+            if (leg->seatIndices[p] != -1) continue;
+            int seatIndex = resolveItinerarySeat(trains, itinerary, l, p);
+            if (seatIndex < 0) return 0;
+            leg->seatIndices[p] = seatIndex;
+        }
     }
+    return 1;
+}
 
-    Seat *seat = &trains[trainIndex].classes[classIndex].seats[seatIndex];
-    if (!seat->isReserved) {
-        printf("Seat is not reserved.\n");
-        return;
-    }
+// Reserves every seat of an itinerary, or none of them. Seats are not held while the passenger
+// pays; instead the class versions read when the seats were chosen are validated here, and legs
+// that changed are re-read and retried. Validation and the reservations run without yielding to
+// other sessions, and the whole commit is written by a single saveTrainData.
+// Returns 1 if the journey was booked, 0 if chosen seats were taken and could not be replaced, or
+// -1 if it could not be saved, in which case no seat stays reserved either.
+int commitItinerary(Train trains[], Itinerary *itinerary) {
+    for (int attempt = 0; attempt < ITINERARY_COMMIT_ATTEMPTS; attempt++) {
+        if (!validateItinerary(trains, itinerary)) {
+            if (!refreshItinerary(trains, itinerary)) return 0;
+            continue;
+        }
 
-    seat->isReserved = 0;
-    seat->passengerName[0] = '\0';
-    printf("Reservation cancelled for seat %d in %s class on train %s.\n", seatNum,
-           trains[trainIndex].classes[classIndex].className, trains[trainIndex].trainName);
-    saveData(trains); // Save data after successful cancellation
+        for (int l = 0; l < itinerary->legCount; l++) {
+            ItineraryLeg *leg = &itinerary->legs[l];
+            for (int p = 0; p < itinerary->passengerCount; p++) {
+                occupySeat(&trains[leg->trainIndex].classes[leg->classIndex], leg->seatIndices[p],
+                           itinerary->passengerNames[p]);
+                publishSeatEvent(SEAT_EVENT_RESERVE, leg->trainIndex, leg->classIndex, leg->seatIndices[p],
+                                 itinerary->passengerNames[p]);
+            }
+        }
+        if (saveTrainData(trains)) return 1;
+
+        // Not on disk, so not booked: undo the reservations in memory too
+        for (int l = 0; l < itinerary->legCount; l++) {
+            ItineraryLeg *leg = &itinerary->legs[l];
+            for (int p = 0; p < itinerary->passengerCount; p++) {
+                publishSeatEvent(SEAT_EVENT_ROLLBACK, leg->trainIndex, leg->classIndex, leg->seatIndices[p],
+                                 itinerary->passengerNames[p]);
+                releaseSeat(&trains[leg->trainIndex].classes[leg->classIndex], leg->seatIndices[p]);
+            }
+        }
+        return -1;
+    }
+    return 0;
 }
 
-// Displays only the reserved seats for a selected train and class, including passenger names.
-void displayReservedSeats(Train trains[]) {
-    int trainIndex;
-    selectTrain(trains, &trainIndex);
-    if (trainIndex == -1) return;
-
-    printf("\n--- Reserved Seats for %s (%s) ---\n", trains[trainIndex].trainName, trains[trainIndex].route);
+// Writes the reserved seats and passenger names of every class of one train.
+void writeReservedSeats(FILE *out, Train trains[], int trainIndex) {
+    fprintf(out, "\n--- Reserved Seats for %s (%s) ---\n", trains[trainIndex].trainName, trains[trainIndex].route);
     for (int c = 0; c < CLASSES; c++) {
-        printf("  %s Class:\n", trains[trainIndex].classes[c].className);
+        fprintf(out, "  %s Class:\n", trains[trainIndex].classes[c].className);
         int reservedFound = 0;
-        for (int s = 0; s < SEATS_PER_CLASS; s++) {
+        const CoachLayout *layout = trains[trainIndex].classes[c].layout;
+        for (int s = 0; s < layout->seatCount; s++) {
             Seat seat = trains[trainIndex].classes[c].seats[s];
             if (seat.isReserved) {
                 if (!reservedFound) {
-                    printf("    Reserved Seats:\n");
+                    fprintf(out, "    Reserved Seats:\n");
                     reservedFound = 1;
                 }
-                printf("      Seat %2d: %s\n", seat.seatNumber, seat.passengerName);
+                fprintf(out, "      Seat %2d %-2s: %s\n", seat.seatNumber, berthCodes[berthTypeOf(layout, s)], seat.passengerName);
             }
         }
         if (!reservedFound) {
-            printf("    No reserved seats in this class.\n");
+            fprintf(out, "    No reserved seats in this class.\n");
         }
     }
 }
 
-// Displays a visual representation of the seat chart for a selected train.
-void displaySeatChart(Train trains[]) {
-    int trainIndex;
-    selectTrain(trains, &trainIndex);
-    if (trainIndex == -1) return;
-
-    printf("\n--- Seat Chart for %s (%s) ---\n", trains[trainIndex].trainName, trains[trainIndex].route);
+// Writes the seat chart of one train, marking reserved seats with 'X'.
+void writeSeatChart(FILE *out, Train trains[], int trainIndex) {
+    fprintf(out, "\n--- Seat Chart for %s (%s) ---\n", trains[trainIndex].trainName, trains[trainIndex].route);
 
     for (int c = 0; c < CLASSES; c++) {
-        printf("\n%s Class:\n", trains[trainIndex].classes[c].className);
-        for (int s = 0; s < SEATS_PER_CLASS; s++) {
+        const CoachLayout *layout = trains[trainIndex].classes[c].layout;
+        fprintf(out, "\n%s Class (%s):\n", trains[trainIndex].classes[c].className, layout->name);
+        for (int s = 0; s < layout->seatCount; s++) {
             Seat seat = trains[trainIndex].classes[c].seats[s];
             if (seat.isReserved) {
-                printf("[ X ] "); // 'X' for reserved seats
+                fprintf(out, "[  X   ] "); // 'X' for reserved seats
             } else {
-                printf("[%-2d] ", seat.seatNumber); // Seat number for available seats
+                // Seat number and berth type for available seats
+                fprintf(out, "[%2d %-3s] ", seat.seatNumber, berthCodes[berthTypeOf(layout, s)]);
             }
-            if ((s + 1) % 5 == 0) { // Print 5 seats per row for better visualization
-                printf("\n");
+            if ((s + 1) % layout->bayLength == 0) { // One bay (or chair-car row) per line
+                fprintf(out, "\n");
             }
         }
-        printf("\n");
+        fprintf(out, "\n");
     }
 }
 
-// --- Data Persistence Functions ---
+// Writes the free-seat matrix for every train and class, straight from the maintained counters.
+void writeAvailability(FILE *out, Train trains[]) {
+    fprintf(out, "\n--- Seat Availability (free seats per class) ---\n");
+    fprintf(out, "%-25s", "Train");
+    for (int c = 0; c < CLASSES; c++) {
+        fprintf(out, " %4s", classCodes[c]);
+    }
+    fprintf(out, " %6s\n", "Total");
 
-// Saves train and user data to files
-void saveData(Train trains[]) {
-    FILE *train_fp = fopen("train_data.txt", "w");
-    FILE *user_fp = fopen("user_data.txt", "w");
+    for (int i = 0; i < TRAINS; i++) {
+        int trainFree = 0;
+        fprintf(out, "%-25s", trains[i].trainName);
+        for (int c = 0; c < CLASSES; c++) {
+            fprintf(out, " %4d", trains[i].classes[c].freeSeats);
+            trainFree += trains[i].classes[c].freeSeats;
+        }
+        fprintf(out, " %6d\n", trainFree);
+    }
+}
 
-    if (train_fp == NULL) {
-        perror("Error opening train_data.txt for writing");
-        return;
+// Writes scheduler queue depths and counters along with the seat feed's backpressure counters.
+void writeSystemStatus(FILE *out) {
+    updateBookingOverload();
+    fprintf(out, "\n--- System Status ---\n");
+    fprintf(out, "%-12s %5s %8s %8s %6s %9s %8s %7s %7s %8s\n",
+            "Lane", "Depth", "Admitted", "Rejected", "Shed", "Completed", "Last ms", "p50 ms", "p99 ms", "Max ms");
+    for (int lane = 0; lane < LANE_COUNT; lane++) {
+        RequestQueue *queue = &requestQueues[lane];
+        fprintf(out, "%-12s %5d %8lu %8lu %6lu %9lu %8ld %7ld %7ld %8ld\n", laneNames[lane], queue->count,
+                queue->admitted, queue->rejected, queue->shed, queue->completed, queue->lastWaitMs,
+                waitPercentileMs(queue, 50), waitPercentileMs(queue, 99), queue->maxWaitMs);
     }
-    if (user_fp == NULL) {
-        perror("Error opening user_data.txt for writing");
-        fclose(train_fp);
-        return;
+    fprintf(out, "Percentiles are queue waits, rounded up to the histogram bucket they fall in.\n");
+    fprintf(out, "Booking latency target %d ms: %s\n", BOOKING_LATENCY_TARGET_MS,
+            bookingOverloaded ? "MISSED (shedding read/report work)" : "met");
+    fprintf(out, "Seat feed: %lu event(s) published, %lu delivered, %lu dropped.\n",
+            atomic_load(&seatFeed.published), seatFeed.delivered, atomic_load(&seatFeed.dropped));
+}
+
+// --- Request Scheduler ---
+
+// Milliseconds elapsed on the monotonic clock since 'since'.
+long elapsedMs(const struct timespec *since) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1000 + (now.tv_nsec - since->tv_nsec) / 1000000;
+}
+
+// Queue wait, in ms, that 'percentile' percent of a lane's dispatched requests stayed within. Read
+// from the histogram, so it is the upper bound of the bucket the percentile falls in (the worst wait
+// seen for the open-ended last bucket).
+long waitPercentileMs(const RequestQueue *queue, int percentile) {
+    unsigned long total = 0;
+    for (int bucket = 0; bucket < WAIT_BUCKETS; bucket++) total += queue->waitHistogram[bucket];
+    if (total == 0) return 0;
+
+    unsigned long rank = (total * percentile + 99) / 100; // Requests that must fall at or below the answer
+    unsigned long seen = 0;
+    for (int bucket = 0; bucket < WAIT_BUCKETS - 1; bucket++) {
+        seen += queue->waitHistogram[bucket];
+        if (seen >= rank) return waitBucketLimitsMs[bucket];
     }
+    return queue->maxWaitMs;
+}
 
-    // Save user data
-    fprintf(user_fp, "%d\n", userCount); // First, save the number of users
-    for (int i = 0; i < userCount; i++) {
-        fprintf(user_fp, "%s\n", users[i].username);
-        fprintf(user_fp, "%s\n", users[i].password_hash);
+// Recomputes bookingOverloaded from the age of the oldest queued booking, so the flag clears as
+// soon as the booking lane catches up or drains.
+void updateBookingOverload() {
+    RequestQueue *queue = &requestQueues[LANE_BOOKING];
+    bookingOverloaded = queue->count > 0 &&
+                        elapsedMs(&queue->requests[queue->head].enqueuedAt) > BOOKING_LATENCY_TARGET_MS;
+}
+
+// Queues a request on its priority lane. Returns 1 if admitted, 0 if the lane is full or, for
+// read/report work, if bookings are currently missing their latency target.
+int submitRequest(RequestLane lane, RequestHandler handler, RequestHandler shedHandler, void *context) {
+    RequestQueue *queue = &requestQueues[lane];
+    if (lane == LANE_READ) updateBookingOverload();
+    if (queue->count == SCHEDULER_QUEUE_DEPTH || (lane == LANE_READ && bookingOverloaded)) {
+        queue->rejected++;
+        return 0;
     }
 
-    // Save train data
-    for (int i = 0; i < TRAINS; i++) {
-        fprintf(train_fp, "%s|%s\n", trains[i].trainName, trains[i].route);
-        for (int c = 0; c < CLASSES; c++) {
-            fprintf(train_fp, "%s|%d\n", trains[i].classes[c].className, trains[i].classes[c].fare);
-            for (int s = 0; s < SEATS_PER_CLASS; s++) {
-                fprintf(train_fp, "%d,%d,%s\n",
-                        trains[i].classes[c].seats[s].seatNumber,
-                        trains[i].classes[c].seats[s].isReserved,
-                        trains[i].classes[c].seats[s].passengerName);
-            }
+    Request *request = &queue->requests[(queue->head + queue->count) % SCHEDULER_QUEUE_DEPTH];
+    request->handler = handler;
+    request->shedHandler = shedHandler;
+    request->context = context;
+    clock_gettime(CLOCK_MONOTONIC, &request->enqueuedAt);
+    queue->count++;
+    queue->admitted++;
+    return 1;
+}
+
+// Dispatches up to maxRequests queued requests, always from the highest-priority non-empty lane,
+// so read/report work only runs once no booking or cancellation is waiting. Read/report requests
+// that outlived READ_REQUEST_DEADLINE_MS are shed: their shedHandler runs instead, so whoever is
+// waiting on them hears back. Returns the number dispatched.
+int runScheduler(Train trains[], int maxRequests) {
+    int dispatched = 0;
+
+    updateBookingOverload();
+    while (dispatched < maxRequests) {
+        int lane = 0;
+        while (lane < LANE_COUNT && requestQueues[lane].count == 0) lane++;
+        if (lane == LANE_COUNT) break;
+
+        RequestQueue *queue = &requestQueues[lane];
+        Request request = queue->requests[queue->head];
+        queue->head = (queue->head + 1) % SCHEDULER_QUEUE_DEPTH;
+        queue->count--;
+
+        long waitMs = elapsedMs(&request.enqueuedAt);
+        if (lane == LANE_READ && waitMs > READ_REQUEST_DEADLINE_MS) {
+            queue->shed++;
+            if (request.shedHandler != NULL) request.shedHandler(trains, request.context);
+            continue;
         }
+        queue->lastWaitMs = waitMs;
+        if (waitMs > queue->maxWaitMs) queue->maxWaitMs = waitMs;
+        int bucket = 0;
+        while (bucket < WAIT_BUCKETS - 1 && waitMs > waitBucketLimitsMs[bucket]) bucket++;
+        queue->waitHistogram[bucket]++;
+
+        request.handler(trains, request.context);
+        queue->completed++;
+        dispatched++;
     }
-
-    fclose(train_fp);
-    fclose(user_fp);
-    printf("Data saved successfully!\n");
+    return dispatched;
 }
 
-// Loads train and user data from files
-void loadData(Train trains[]) {
-    FILE *train_fp = fopen("train_data.txt", "r");
-    FILE *user_fp = fopen("user_data.txt", "r");
+// --- Multi-Session Server ---
 
-    if (train_fp == NULL || user_fp == NULL) {
-        printf("No saved data found. Initializing new data.\n");
-        initializeTrains(trains, TRAINS); // Initialize trains with default empty state
-        userCount = 0; // Ensure userCount is 0 if no user data file found
-        if (train_fp) fclose(train_fp); // Close if one was opened but not the other
-        if (user_fp) fclose(user_fp);
+// Appends raw text to a session's pending output, growing the buffer to fit replies as large as a
+// full train's reserved-seat list. A client that lets SESSION_OUTPUT_LIMIT bytes pile up is not
+// reading, so it is flagged and dropped at the next flush rather than allowed to stall.
+void sessionWrite(Session *session, const char *text, size_t length) {
+    if (session->closed || session->outputOverflow) return;
+    if (session->console) { // Written straight through, so it interleaves with other console output in order
+        fwrite(text, 1, length, stdout);
         return;
     }
-
-    // Load user data
-    if (fscanf(user_fp, "%d\n", &userCount) != 1) { // Read the number of users first
-        printf("Error reading user count. User data might be corrupted. Resetting user data.\n");
-        userCount = 0; // Reset user count if read fails
-    } else {
-        if (userCount > MAX_USERS) { // Prevent buffer overflow if file has too many users
-            printf("Warning: Too many users in file, limiting to MAX_USERS (%d).\n", MAX_USERS);
-            userCount = MAX_USERS;
-        }
-        for (int i = 0; i < userCount; i++) {
-            if (fgets(users[i].username, sizeof(users[i].username), user_fp) != NULL) {
-                users[i].username[strcspn(users[i].username, "\n")] = '\0';
-            } else {
-                printf("Error reading username for user %d. User data might be corrupted. Stopping user load.\n", i);
-                userCount = i; // Adjust user count to reflect loaded users
-                break;
-            }
-            if (fgets(users[i].password_hash, sizeof(users[i].password_hash), user_fp) != NULL) {
-                users[i].password_hash[strcspn(users[i].password_hash, "\n")] = '\0';
-            } else {
-                printf("Error reading password hash for user %d. User data might be corrupted. Stopping user load.\n", i);
-                userCount = i; // Adjust user count
-                break;
-            }
+    size_t needed = session->outputLength + length;
+    if (needed > SESSION_OUTPUT_LIMIT) {
+        session->outputOverflow = 1;
+        return;
+    }
+    if (needed > session->outputCapacity) {
+        size_t capacity = session->outputCapacity > 0 ? session->outputCapacity : SESSION_OUTPUT_CHUNK;
+        while (capacity < needed) capacity *= 2;
+        char *output = realloc(session->output, capacity);
+        if (output == NULL) {
+            session->outputOverflow = 1;
+            return;
         }
+        session->output = output;
+        session->outputCapacity = capacity;
     }
+    memcpy(session->output + session->outputLength, text, length);
+    session->outputLength += length;
+}
 
+void sessionPrintf(Session *session, const char *format, ...) {
+    char text[512];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (length < 0) return;
+    if (length >= (int)sizeof(text)) length = sizeof(text) - 1;
+    sessionWrite(session, text, length);
+}
+
+// Opens an in-memory stream so the FILE-based listings (train list, charts) can write to a socket
+// session. The console, the only kind of session off Linux, writes them straight to stdout.
+FILE *openSessionStream(Session *session) {
+    if (session->console) return stdout;
+#ifdef __linux__
+    return open_memstream(&session->streamText, &session->streamLength);
+#else
+    return stdout;
+#endif
+}
+
+void closeSessionStream(Session *session, FILE *out) {
+    if (out == stdout) return;
+    fclose(out);
+    sessionWrite(session, session->streamText, session->streamLength);
+    free(session->streamText);
+    session->streamText = NULL;
+}
+
+// Parses a whole input line as a decimal number. Returns 1 on success.
+int parseNumber(const char *line, int *value) {
+    char *end;
+    long number = strtol(line, &end, 10);
+    if (end == line || *end != '\0' || number < -100000 || number > 100000) return 0;
+    *value = (int)number;
+    return 1;
+}
+
+void sendAuthMenu(Session *session) {
+    session->state = SESSION_AUTH_MENU;
+    sessionPrintf(session, "\n--- Welcome to Train Reservation System ---\n"
+                           "1. Login\n2. Sign Up\n3. Exit\nEnter your choice: ");
+}
+
+void sendMainMenu(Session *session) {
+    session->state = SESSION_MAIN_MENU;
+    sessionPrintf(session, "\n--- Train Reservation System ---\n"
+                           "1. Reserve Seat\n2. Cancel Reservation\n3. Display Seat Chart\n"
+                           "4. Display Reserved Seats Only\n5. Display Availability\n"
+                           "6. Book Multi-Train Journey\n7. Display System Status\n8. Exit\n"
+                           "Enter your choice: ");
+}
+
+void sendTrainList(Train trains[], Session *session, SessionState nextState) {
+    FILE *out = openSessionStream(session);
+    writeTrainList(out, trains);
+    closeSessionStream(session, out);
+    sessionPrintf(session, "Enter train number: ");
+    session->state = nextState;
+}
+
+void sendClassList(Session *session, SessionState nextState) {
+    sessionPrintf(session, "Select Class:\n");
+    for (int i = 0; i < CLASSES; i++) {
+        sessionPrintf(session, "%d. %s\n", i + 1, classNames[i]);
+    }
+    sessionPrintf(session, "Enter class number: ");
+    session->state = nextState;
+}
+
+// Asks for the next seat of a booking, offering the berth types of the coach's layout.
+void sendSeatPrompt(Session *session) {
+    const CoachLayout *layout = session->trains[session->trainIndex].classes[session->classIndex].layout;
+    sessionPrintf(session, "Enter seat number #%d (1-%d), berth type (%s) or 0 for any: ",
+                  session->itineraryPassenger + 1, layout->seatCount, layout->berthHint);
+    session->state = SESSION_BOOK_SEAT;
+}
+
+// Asks for the current passenger's seat on the leg being planned.
+void sendItinerarySeatPrompt(Session *session) {
+    const ItineraryLeg *leg = &session->itinerary.legs[session->itinerary.legCount - 1];
+    const CoachLayout *layout = session->trains[leg->trainIndex].classes[leg->classIndex].layout;
+    sessionPrintf(session, "Seat for %s (1-%d), berth type (%s) or 0 for any: ",
+                  session->itinerary.passengerNames[session->itineraryPassenger], layout->seatCount, layout->berthHint);
+    session->state = SESSION_ITIN_SEAT;
+}
+
+// Shows the planned journey and its fare, then asks for payment. No seats are held meanwhile.
+void sendItineraryPayment(Session *session) {
+    FILE *out = openSessionStream(session);
+    writeItinerary(out, session->trains, &session->itinerary);
+    closeSessionStream(session, out);
+    sessionPrintf(session, "Total Fare: Rs.%d\n", itineraryFare(session->trains, &session->itinerary));
+    sessionPrintf(session, "Select Payment Method:\n");
+    for (int i = 0; i < PAYMENT_COUNT; i++) {
+        sessionPrintf(session, "%d. %s\n", i + 1, paymentTypeNames[i]);
+    }
+    sessionPrintf(session, "Enter choice: ");
+    session->state = SESSION_ITIN_PAYMENT;
+}
+
+// Hands a session's request to the scheduler and parks the session until it has run.
+// Returns 0 (after telling the client) if the scheduler refused the request.
+int submitSessionRequest(Session *session, RequestLane lane, RequestHandler handler) {
+    if (!submitRequest(lane, handler, shedSessionRequest, session)) {
+        sessionPrintf(session, "System busy. Please try again shortly.\n");
+        return 0;
+    }
+    session->pendingRequests++;
+    session->state = SESSION_WAITING;
+    return 1;
+}
+
+// Called at the end of every scheduled session handler. Frees sessions whose client left while the
+// request was queued; otherwise returns the client to the main menu and resumes any buffered input.
+void finishSessionRequest(Session *session) {
+    session->pendingRequests--;
+    if (session->closed) {
+        if (session->pendingRequests == 0) freeSession(session);
+        return;
+    }
+    sendMainMenu(session);
+    processSessionInput(session);
+    flushSession(session);
+}
+
+// Runs instead of a session's read/report request when the scheduler sheds it, so the client is
+// told and returned to the menu rather than left waiting.
+void shedSessionRequest(Train trains[], void *context) {
+    (void)trains;
+    Session *session = context;
+    sessionPrintf(session, "System busy. Please try again shortly.\n");
+    finishSessionRequest(session);
+}
+
+// Scheduled handlers for the session flows; 'context' is the requesting Session.
+// A single booking commits like a one-leg journey, so its seats are only taken once it is paid for.
+void commitBookingRequest(Train trains[], void *context) {
+    Session *session = context;
+    const ItineraryLeg *leg = &session->itinerary.legs[0];
+    TrainClass *trainClass = &trains[leg->trainIndex].classes[leg->classIndex];
+    sessionPrintf(session, "Payment Method: %s\n", paymentTypeNames[session->paymentMethod]);
+    int result = commitItinerary(trains, &session->itinerary);
+    if (result == 1) {
+        // Seats taken by other sessions since they were chosen may have been re-chosen, so show the final ones
+        for (int p = 0; p < session->itinerary.passengerCount; p++) {
+            sessionPrintf(session, "    Seat %2d %-2s: %s\n", leg->seatIndices[p] + 1,
+                          berthCodes[berthTypeOf(trainClass->layout, leg->seatIndices[p])],
+                          session->itinerary.passengerNames[p]);
+        }
+        sessionPrintf(session, "Reservation successful for %d seat(s) on %s in %s class.\n",
+                      session->itinerary.passengerCount, trains[leg->trainIndex].trainName, trainClass->className);
+    } else if (result == 0) {
+        sessionPrintf(session, "Some chosen seats were taken before the booking completed. No seats were reserved; "
+                               "your payment will be refunded.\n");
+    } else {
+        sessionPrintf(session, "The reservation could not be saved. No seats were reserved; your payment will be refunded.\n");
+    }
+    finishSessionRequest(session);
+}
+
+void commitItineraryRequest(Train trains[], void *context) {
+    Session *session = context;
+    sessionPrintf(session, "Payment Method: %s\n", paymentTypeNames[session->paymentMethod]);
+    int result = commitItinerary(trains, &session->itinerary);
+    if (result == 1) {
+        // Seats taken by other sessions since they were chosen may have been re-chosen, so show the final ones
+        FILE *out = openSessionStream(session);
+        writeItinerary(out, trains, &session->itinerary);
+        closeSessionStream(session, out);
+        sessionPrintf(session, "Journey booked: %d leg(s) for %d passenger(s).\n",
+                      session->itinerary.legCount, session->itinerary.passengerCount);
+    } else if (result == 0) {
+        sessionPrintf(session, "Some chosen seats were taken before the booking completed. No seats were reserved; "
+                               "your payment will be refunded.\n");
+    } else {
+        sessionPrintf(session, "The journey could not be saved. No seats were reserved; your payment will be refunded.\n");
+    }
+    finishSessionRequest(session);
+}
+
+void cancelSeatRequest(Train trains[], void *context) {
+    Session *session = context;
+    TrainClass *trainClass = &trains[session->trainIndex].classes[session->classIndex];
+    Seat *seat = &trainClass->seats[session->pendingSeatIndex];
+    if (!seat->isReserved) {
+        sessionPrintf(session, "Seat is not reserved.\n");
+    } else {
+        char passengerName[50];
+        strcpy(passengerName, seat->passengerName);
+        publishSeatEvent(SEAT_EVENT_CANCEL, session->trainIndex, session->classIndex, session->pendingSeatIndex,
+                         passengerName);
+        releaseSeat(trainClass, session->pendingSeatIndex);
+        if (saveTrainData(trains)) {
+            sessionPrintf(session, "Reservation cancelled for seat %d in %s class on train %s.\n",
+                          session->pendingSeatIndex + 1, trainClass->className, trains[session->trainIndex].trainName);
+        } else {
+            occupySeat(trainClass, session->pendingSeatIndex, passengerName); // Still booked on disk
+            publishSeatEvent(SEAT_EVENT_RESERVE, session->trainIndex, session->classIndex, session->pendingSeatIndex,
+                             passengerName);
+            sessionPrintf(session, "The cancellation could not be saved. Your reservation is unchanged.\n");
+        }
+    }
+    finishSessionRequest(session);
+}
+
+void seatChartRequest(Train trains[], void *context) {
+    Session *session = context;
+    if (!session->closed) {
+        FILE *out = openSessionStream(session);
+        writeSeatChart(out, trains, session->trainIndex);
+        closeSessionStream(session, out);
+    }
+    finishSessionRequest(session);
+}
+
+void reservedSeatsRequest(Train trains[], void *context) {
+    Session *session = context;
+    if (!session->closed) {
+        FILE *out = openSessionStream(session);
+        writeReservedSeats(out, trains, session->trainIndex);
+        closeSessionStream(session, out);
+    }
+    finishSessionRequest(session);
+}
+
+void availabilityRequest(Train trains[], void *context) {
+    Session *session = context;
+    if (!session->closed) {
+        FILE *out = openSessionStream(session);
+        writeAvailability(out, trains);
+        closeSessionStream(session, out);
+    }
+    finishSessionRequest(session);
+}
 
-    // Load train data (similar logic as before)
+// Advances a session's state machine by one line of client input. Each state does the work of one
+// prompt of the dialogs, then writes the next prompt and returns without blocking.
+void handleSessionLine(Session *session, char *line) {
+    Train *trains = session->trains;
+    int number;
+
+    switch (session->state) {
+        case SESSION_AUTH_MENU:
+            if (!parseNumber(line, &number)) {
+                sessionPrintf(session, "Invalid input. Please enter a number.\n");
+                sendAuthMenu(session);
+            } else if (number == 1) {
+                if (userCount == 0) {
+                    sessionPrintf(session, "\nNo accounts found. Please sign up first.\n");
+                    sendAuthMenu(session);
+                } else {
+                    session->attemptsLeft = 3;
+                    sessionPrintf(session, "\n==== Train Reservation System Login ====\nUsername: ");
+                    session->state = SESSION_LOGIN_USERNAME;
+                }
+            } else if (number == 2) {
+                sessionPrintf(session, "\n==== Train Reservation System Signup ====\n");
+                if (userCount >= MAX_USERS) {
+                    sessionPrintf(session, "Maximum number of users reached. Cannot create new account.\n");
+                    sendAuthMenu(session);
+                } else {
+                    sessionPrintf(session, "Enter new username: ");
+                    session->state = SESSION_SIGNUP_USERNAME;
+                }
+            } else if (number == 3) {
+                sessionPrintf(session, "Exiting Train Reservation System. Goodbye!\n");
+                session->closeAfterFlush = 1;
+            } else {
+                sessionPrintf(session, "Invalid choice. Please enter 1, 2, or 3.\n");
+                sendAuthMenu(session);
+            }
+            break;
+
+        case SESSION_LOGIN_USERNAME:
+            snprintf(session->username, sizeof(session->username), "%s", line);
+            sessionPrintf(session, "Password: ");
+            session->state = SESSION_LOGIN_PASSWORD;
+            break;
+
+        case SESSION_LOGIN_PASSWORD: {
+            char hashed_password_input[50];
+            hashPassword(line, hashed_password_input);
+            for (int i = 0; i < userCount; i++) {
+                if (strcmp(session->username, users[i].username) == 0 &&
+                    strcmp(hashed_password_input, users[i].password_hash) == 0) {
+                    sessionPrintf(session, "Login successful! Welcome, %s.\n", session->username);
+                    sendMainMenu(session);
+                    return;
+                }
+            }
+            session->attemptsLeft--;
+            sessionPrintf(session, "Invalid credentials. Attempts left: %d\n", session->attemptsLeft);
+            if (session->attemptsLeft == 0) {
+                sessionPrintf(session, "Too many failed attempts. Exiting...\n");
+                session->closeAfterFlush = 1;
+            } else {
+                sessionPrintf(session, "Username: ");
+                session->state = SESSION_LOGIN_USERNAME;
+            }
+            break;
+        }
+
+        case SESSION_SIGNUP_USERNAME:
+            for (int i = 0; i < userCount; i++) {
+                if (strcmp(line, users[i].username) == 0) {
+                    sessionPrintf(session, "Error: Username '%s' already taken. Please choose another.\n", line);
+                    sendAuthMenu(session);
+                    return;
+                }
+            }
+            snprintf(session->username, sizeof(session->username), "%s", line);
+            sessionPrintf(session, "Enter new password: ");
+            session->state = SESSION_SIGNUP_PASSWORD;
+            break;
+
+        case SESSION_SIGNUP_PASSWORD:
+            // Another session may have taken the last slot or the same name since the username prompt
+            if (userCount >= MAX_USERS) {
+                sessionPrintf(session, "Maximum number of users reached. Cannot create new account.\n");
+                sendAuthMenu(session);
+                return;
+            }
+            for (int i = 0; i < userCount; i++) {
+                if (strcmp(session->username, users[i].username) == 0) {
+                    sessionPrintf(session, "Error: Username '%s' already taken. Please choose another.\n", session->username);
+                    sendAuthMenu(session);
+                    return;
+                }
+            }
+            strcpy(users[userCount].username, session->username);
+            hashPassword(line, users[userCount].password_hash);
+            userCount++;
+            if (saveUserData()) {
+                sessionPrintf(session, "Account for '%s' created successfully!\n", session->username);
+            } else {
+                userCount--;
+                sessionPrintf(session, "The account could not be saved. Please try again later.\n");
+            }
+            sendAuthMenu(session);
+            break;
+
+        case SESSION_MAIN_MENU:
+            if (!parseNumber(line, &number)) {
+                sessionPrintf(session, "Invalid input. Please enter a number.\n");
+                sendMainMenu(session);
+            } else if (number == 1) {
+                sendTrainList(trains, session, SESSION_BOOK_TRAIN);
+            } else if (number == 2) {
+                sendTrainList(trains, session, SESSION_CANCEL_TRAIN);
+            } else if (number == 3 || number == 4) {
+                session->viewHandler = number == 3 ? seatChartRequest : reservedSeatsRequest;
+                sendTrainList(trains, session, SESSION_VIEW_TRAIN);
+            } else if (number == 5) {
+                if (!submitSessionRequest(session, LANE_READ, availabilityRequest)) sendMainMenu(session);
+            } else if (number == 6) {
+                memset(&session->itinerary, 0, sizeof(session->itinerary));
+                sessionPrintf(session, "\n==== Multi-Train Journey ====\n");
+                sessionPrintf(session, "Enter number of passengers (1-%d): ", MAX_ITINERARY_PASSENGERS);
+                session->state = SESSION_ITIN_PASSENGERS;
+            } else if (number == 7) {
+                FILE *out = openSessionStream(session);
+                writeSystemStatus(out);
+                closeSessionStream(session, out);
+                sendMainMenu(session);
+            } else if (number == 8) {
+                sessionPrintf(session, "Exiting Train Reservation System. Bye!\n");
+                session->closeAfterFlush = 1;
+            } else {
+                sessionPrintf(session, "Invalid choice. Please enter a number between 1 and 8.\n");
+                sendMainMenu(session);
+            }
+            break;
+
+        case SESSION_BOOK_TRAIN:
+        case SESSION_CANCEL_TRAIN:
+        case SESSION_VIEW_TRAIN:
+            if (!parseNumber(line, &number) || number < 1 || number > TRAINS) {
+                sessionPrintf(session, "Invalid train selection.\n");
+                sendMainMenu(session);
+                return;
+            }
+            session->trainIndex = number - 1;
+            if (session->state == SESSION_BOOK_TRAIN) {
+                sessionPrintf(session, "\nStations for %s:\n", trains[session->trainIndex].trainName);
+                for (int i = 0; trainRoutes[session->trainIndex][i] != NULL; i++) {
+                    sessionPrintf(session, "    - %s\n", trainRoutes[session->trainIndex][i]);
+                }
+                sessionPrintf(session, "\nEnter boarding station: ");
+                session->state = SESSION_BOOK_FROM;
+            } else if (session->state == SESSION_CANCEL_TRAIN) {
+                sendClassList(session, SESSION_CANCEL_CLASS);
+            } else if (!submitSessionRequest(session, LANE_READ, session->viewHandler)) {
+                sendMainMenu(session);
+            }
+            break;
+
+        case SESSION_BOOK_FROM:
+            snprintf(session->from, sizeof(session->from), "%s", line);
+            sessionPrintf(session, "Enter destination station: ");
+            session->state = SESSION_BOOK_TO;
+            break;
+
+        case SESSION_BOOK_TO: {
+            char to[50];
+            snprintf(to, sizeof(to), "%s", line);
+            if (!validateRoute(session->trainIndex, session->from, to)) {
+                sessionPrintf(session, "Invalid route for this train or stations are in incorrect order. Reservation cancelled.\n");
+                sendMainMenu(session);
+                return;
+            }
+            memset(&session->itinerary, 0, sizeof(session->itinerary));
+            session->itinerary.legs[0].trainIndex = session->trainIndex;
+            strcpy(session->itinerary.legs[0].from, session->from);
+            strcpy(session->itinerary.legs[0].to, to);
+            sendClassList(session, SESSION_BOOK_CLASS);
+            break;
+        }
+
+        case SESSION_BOOK_CLASS:
+        case SESSION_CANCEL_CLASS:
+            if (!parseNumber(line, &number) || number < 1 || number > CLASSES) {
+                sessionPrintf(session, "Invalid class selection.\n");
+                sendMainMenu(session);
+                return;
+            }
+            session->classIndex = number - 1;
+            if (session->state == SESSION_BOOK_CLASS) {
+                sessionPrintf(session, "Enter number of seats to reserve (1-%d): ", MAX_ITINERARY_PASSENGERS);
+                session->state = SESSION_BOOK_COUNT;
+            } else {
+                sessionPrintf(session, "Enter seat number to cancel (1-%d): ",
+                              trains[session->trainIndex].classes[session->classIndex].layout->seatCount);
+                session->state = SESSION_CANCEL_SEAT;
+            }
+            break;
+
+        case SESSION_BOOK_COUNT: {
+            Itinerary *itinerary = &session->itinerary;
+            ItineraryLeg *leg = &itinerary->legs[0];
+            if (!parseNumber(line, &number) || number < 1 || number > MAX_ITINERARY_PASSENGERS) {
+                sessionPrintf(session, "Invalid number of seats.\n");
+                sendMainMenu(session);
+                return;
+            }
+            // Seats are chosen here but only taken by commitBookingRequest, so nothing is held until payment
+            itinerary->passengerCount = number;
+            itinerary->legCount = 1;
+            leg->classIndex = session->classIndex;
+            leg->readVersion = trains[leg->trainIndex].classes[leg->classIndex].version;
+            for (int p = 0; p < number; p++) leg->seatIndices[p] = -1;
+            session->itineraryPassenger = 0;
+            sendSeatPrompt(session);
+            break;
+        }
+
+        case SESSION_BOOK_SEAT: {
+            ItineraryLeg *leg = &session->itinerary.legs[0];
+            int passenger = session->itineraryPassenger;
+            snprintf(leg->seatChoices[passenger], sizeof(leg->seatChoices[passenger]), "%s", line);
+
+            int seatIndex = resolveItinerarySeat(trains, &session->itinerary, 0, passenger);
+            if (seatIndex < 0) {
+                sessionPrintf(session, "%s\n", seatChoiceError(seatIndex));
+                sendSeatPrompt(session);
+                return;
+            }
+            leg->seatIndices[passenger] = seatIndex;
+            sessionPrintf(session, "Enter passenger name for seat %d (%s): ", seatIndex + 1,
+                          berthNames[berthTypeOf(trains[leg->trainIndex].classes[leg->classIndex].layout, seatIndex)]);
+            session->state = SESSION_BOOK_NAME;
+            break;
+        }
+
+        case SESSION_BOOK_NAME: {
+            Itinerary *itinerary = &session->itinerary;
+            snprintf(itinerary->passengerNames[session->itineraryPassenger],
+                     sizeof(itinerary->passengerNames[0]), "%s", line);
+            if (++session->itineraryPassenger < itinerary->passengerCount) {
+                sendSeatPrompt(session);
+                return;
+            }
+            sessionPrintf(session, "Total Fare for %d seat(s): Rs.%d\n", itinerary->passengerCount,
+                          itineraryFare(trains, itinerary));
+            sessionPrintf(session, "Select Payment Method:\n");
+            for (int i = 0; i < PAYMENT_COUNT; i++) {
+                sessionPrintf(session, "%d. %s\n", i + 1, paymentTypeNames[i]);
+            }
+            sessionPrintf(session, "Enter choice: ");
+            session->state = SESSION_BOOK_PAYMENT;
+            break;
+        }
+
+        case SESSION_BOOK_PAYMENT:
+            if (!parseNumber(line, &number) || number < 1 || number > PAYMENT_COUNT) {
+                sessionPrintf(session, "Payment failed or cancelled. No seats were reserved.\n");
+                sendMainMenu(session);
+                return;
+            }
+            session->paymentMethod = number - 1;
+            if (!submitSessionRequest(session, LANE_BOOKING, commitBookingRequest)) sendMainMenu(session);
+            break;
+
+        case SESSION_CANCEL_SEAT:
+            if (!parseNumber(line, &number) ||
+                findSeatIndex(&trains[session->trainIndex].classes[session->classIndex], number) == -1) {
+                sessionPrintf(session, "Invalid seat number.\n");
+                sendMainMenu(session);
+                return;
+            }
+            session->pendingSeatIndex = number - 1;
+            if (!submitSessionRequest(session, LANE_CANCEL, cancelSeatRequest)) sendMainMenu(session);
+            break;
+
+        case SESSION_ITIN_PASSENGERS:
+            if (!parseNumber(line, &number) || number < 1 || number > MAX_ITINERARY_PASSENGERS) {
+                sessionPrintf(session, "Invalid number of passengers.\n");
+                sendMainMenu(session);
+                return;
+            }
+            session->itinerary.passengerCount = number;
+            session->itineraryPassenger = 0;
+            sessionPrintf(session, "Enter name of passenger 1: ");
+            session->state = SESSION_ITIN_NAME;
+            break;
+
+        case SESSION_ITIN_NAME: {
+            Itinerary *itinerary = &session->itinerary;
+            snprintf(itinerary->passengerNames[session->itineraryPassenger],
+                     sizeof(itinerary->passengerNames[0]), "%s", line);
+            if (++session->itineraryPassenger < itinerary->passengerCount) {
+                sessionPrintf(session, "Enter name of passenger %d: ", session->itineraryPassenger + 1);
+                return;
+            }
+            sessionPrintf(session, "\n-- Leg 1 --\n");
+            sendTrainList(trains, session, SESSION_ITIN_TRAIN);
+            break;
+        }
+
+        case SESSION_ITIN_TRAIN: {
+            Itinerary *itinerary = &session->itinerary;
+            ItineraryLeg *leg = &itinerary->legs[itinerary->legCount];
+            if (!parseNumber(line, &number) || number < 1 || number > TRAINS) {
+                sessionPrintf(session, "Invalid train selection.\n");
+                sendMainMenu(session);
+                return;
+            }
+            leg->trainIndex = number - 1;
+            sessionPrintf(session, "\nStations for %s:\n", trains[leg->trainIndex].trainName);
+            for (int i = 0; trainRoutes[leg->trainIndex][i] != NULL; i++) {
+                sessionPrintf(session, "    - %s\n", trainRoutes[leg->trainIndex][i]);
+            }
+            if (itinerary->legCount == 0) {
+                sessionPrintf(session, "\nEnter boarding station: ");
+                session->state = SESSION_ITIN_FROM;
+            } else {
+                strcpy(leg->from, itinerary->legs[itinerary->legCount - 1].to); // Connections board where the last leg ends
+                sessionPrintf(session, "\nBoarding at %s.\nEnter destination station: ", leg->from);
+                session->state = SESSION_ITIN_TO;
+            }
+            break;
+        }
+
+        case SESSION_ITIN_FROM:
+            snprintf(session->itinerary.legs[0].from, sizeof(session->itinerary.legs[0].from), "%s", line);
+            sessionPrintf(session, "Enter destination station: ");
+            session->state = SESSION_ITIN_TO;
+            break;
+
+        case SESSION_ITIN_TO: {
+            ItineraryLeg *leg = &session->itinerary.legs[session->itinerary.legCount];
+            snprintf(leg->to, sizeof(leg->to), "%s", line);
+            if (!validateRoute(leg->trainIndex, leg->from, leg->to)) {
+                sessionPrintf(session, "Invalid route for this train or stations are in incorrect order. Journey cancelled.\n");
+                sendMainMenu(session);
+                return;
+            }
+            sendClassList(session, SESSION_ITIN_CLASS);
+            break;
+        }
+
+        case SESSION_ITIN_CLASS: {
+            Itinerary *itinerary = &session->itinerary;
+            ItineraryLeg *leg = &itinerary->legs[itinerary->legCount];
+            if (!parseNumber(line, &number) || number < 1 || number > CLASSES) {
+                sessionPrintf(session, "Invalid class selection.\n");
+                sendMainMenu(session);
+                return;
+            }
+            leg->classIndex = number - 1;
+            leg->readVersion = trains[leg->trainIndex].classes[leg->classIndex].version;
+            for (int p = 0; p < itinerary->passengerCount; p++) leg->seatIndices[p] = -1;
+            itinerary->legCount++;
+            session->itineraryPassenger = 0;
+            sendItinerarySeatPrompt(session);
+            break;
+        }
+
+        case SESSION_ITIN_SEAT: {
+            Itinerary *itinerary = &session->itinerary;
+            int legIndex = itinerary->legCount - 1;
+            ItineraryLeg *leg = &itinerary->legs[legIndex];
+            int passenger = session->itineraryPassenger;
+            snprintf(leg->seatChoices[passenger], sizeof(leg->seatChoices[passenger]), "%s", line);
+
+            int seatIndex = resolveItinerarySeat(trains, itinerary, legIndex, passenger);
+            if (seatIndex < 0) {
+                sessionPrintf(session, "%s\n", seatChoiceError(seatIndex));
+                sendItinerarySeatPrompt(session);
+                return;
+            }
+            leg->seatIndices[passenger] = seatIndex;
+            if (++session->itineraryPassenger < itinerary->passengerCount) {
+                sendItinerarySeatPrompt(session);
+            } else if (itinerary->legCount < MAX_ITINERARY_LEGS) {
+                sessionPrintf(session, "Add a connecting train from %s? (y/n): ", leg->to);
+                session->state = SESSION_ITIN_MORE;
+            } else {
+                sendItineraryPayment(session);
+            }
+            break;
+        }
+
+        case SESSION_ITIN_MORE:
+            if (tolower((unsigned char)line[0]) == 'y') {
+                sessionPrintf(session, "\n-- Leg %d --\n", session->itinerary.legCount + 1);
+                sendTrainList(trains, session, SESSION_ITIN_TRAIN);
+            } else {
+                sendItineraryPayment(session);
+            }
+            break;
+
+        case SESSION_ITIN_PAYMENT:
+            if (!parseNumber(line, &number) || number < 1 || number > PAYMENT_COUNT) {
+                sessionPrintf(session, "Payment failed or cancelled. No seats were reserved.\n");
+                sendMainMenu(session);
+                return;
+            }
+            session->paymentMethod = number - 1;
+            if (!submitSessionRequest(session, LANE_BOOKING, commitItineraryRequest)) sendMainMenu(session);
+            break;
+
+        case SESSION_WAITING:
+            break; // processSessionInput holds input back until the scheduled request has run
+    }
+}
+
+// Feeds every complete buffered line to the state machine. Lines that arrive while a request is
+// queued stay buffered and are picked up by finishSessionRequest. An over-long line is rejected as
+// a whole: everything up to its newline is dropped rather than read as the next answer.
+void processSessionInput(Session *session) {
+    while (!session->closed && !session->closeAfterFlush && session->state != SESSION_WAITING) {
+        char *newline = memchr(session->input, '\n', session->inputLength);
+        if (newline == NULL) {
+            if (session->inputLength == (int)sizeof(session->input) || session->discardingInput) {
+                if (!session->discardingInput) sessionPrintf(session, "Input too long.\n");
+                session->inputLength = 0; // A line this long is not a valid answer to any prompt
+                session->discardingInput = 1;
+            }
+            return;
+        }
+
+        *newline = '\0';
+        int consumed = newline - session->input + 1;
+        if (session->discardingInput) {
+            session->discardingInput = 0; // End of the over-long line; the prompt is still waiting
+        } else {
+            session->input[strcspn(session->input, "\r")] = '\0';
+            handleSessionLine(session, session->input);
+        }
+
+        session->inputLength -= consumed;
+        memmove(session->input, session->input + consumed, session->inputLength);
+    }
+}
+
+// Writes as much pending output as the socket accepts and watches for writability only while
+// output remains. Closes the session if it asked to close and is drained, or if it overflowed.
+// Returns 1 if the session is closed, in which case it may already have been freed.
+int flushSession(Session *session) {
+    if (session->closed) return 1;
+    if (session->console) {
+        fflush(stdout);
+        if (session->closeAfterFlush) closeSession(session);
+        return session->closed;
+    }
+#ifdef __linux__
+    if (session->outputOverflow) {
+        closeSession(session);
+        return 1;
+    }
+
+    size_t written = 0;
+    while (written < session->outputLength) {
+        ssize_t n = send(session->fd, session->output + written, session->outputLength - written, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            closeSession(session);
+            return 1;
+        }
+        written += n;
+    }
+    session->outputLength -= written;
+    memmove(session->output, session->output + written, session->outputLength);
+    if (session->outputLength == 0) {
+        session->outputStalledSince = 0;
+    } else if (written > 0 || session->outputStalledSince == 0) {
+        session->outputStalledSince = time(NULL);
+    }
+
+    if (session->outputLength == 0 && session->closeAfterFlush) {
+        closeSession(session);
+        return 1;
+    }
+
+    int wantsWrite = session->outputLength > 0;
+    if (wantsWrite != session->wantsWrite) {
+        struct epoll_event event = { .events = EPOLLIN | (wantsWrite ? EPOLLOUT : 0), .data.ptr = session };
+        epoll_ctl(serverEpollFd, EPOLL_CTL_MOD, session->fd, &event);
+        session->wantsWrite = wantsWrite;
+    }
+#endif
+    return 0;
+}
+
+// Disconnects a session. The Session is freed now unless a scheduled request still refers to it,
+// in which case that request frees it.
+void closeSession(Session *session) {
+    if (session->closed) return;
+    if (session->console) {
+        session->closed = 1; // Owned by runConsoleSession
+        return;
+    }
+
+#ifdef __linux__
+    epoll_ctl(serverEpollFd, EPOLL_CTL_DEL, session->fd, NULL);
+#endif
+    close(session->fd);
+    session->closed = 1;
+    sessions[session->slot] = NULL;
+    sessionCount--;
+
+    if (session->pendingRequests == 0) freeSession(session);
+}
+
+void freeSession(Session *session) {
+    free(session->output);
+    free(session);
+}
+
+// Runs the login and booking dialogs on the console. The console is one more session of the state
+// machine the socket server drives, fed a line at a time from stdin, so both offer the same menus.
+void runConsoleSession(Train trains[]) {
+    Session session;
+    memset(&session, 0, sizeof(session));
+    session.fd = -1;
+    session.console = 1;
+    session.trains = trains;
+    sendAuthMenu(&session);
+
+    char line[sizeof(session.input)];
+    while (!flushSession(&session) && fgets(line, sizeof(line), stdin) != NULL) {
+        int length = strlen(line);
+        if (length > (int)sizeof(session.input) - session.inputLength) {
+            length = sizeof(session.input) - session.inputLength;
+        }
+        memcpy(session.input + session.inputLength, line, length);
+        session.inputLength += length;
+        processSessionInput(&session);
+
+        // Bookings, cancellations and reports go through the scheduler just as they do for socket sessions
+        runScheduler(trains, SCHEDULER_QUEUE_DEPTH * LANE_COUNT);
+        drainSeatFeed(trains); // Hand this action's seat changes to feed consumers
+    }
+    closeSession(&session);
+}
+
+#ifdef __linux__
+// Accepts every pending connection on the listening socket and greets each new session.
+void acceptSessions(Train trains[], int listenFd) {
+    for (;;) {
+        int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept");
+            return;
+        }
+
+        Session *session = NULL;
+        if (sessionCount < MAX_SESSIONS) session = calloc(1, sizeof(Session));
+        if (session == NULL) {
+            const char *message = "Server busy. Please try again later.\n";
+            send(fd, message, strlen(message), MSG_NOSIGNAL);
+            close(fd);
+            continue;
+        }
+
+        session->fd = fd;
+        session->trains = trains;
+        session->lastActivity = time(NULL);
+        while (sessions[nextSessionSlot] != NULL) {
+            nextSessionSlot = (nextSessionSlot + 1) % MAX_SESSIONS;
+        }
+        session->slot = nextSessionSlot;
+        sessions[nextSessionSlot] = session;
+        sessionCount++;
+
+        struct epoll_event event = { .events = EPOLLIN, .data.ptr = session };
+        if (epoll_ctl(serverEpollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            perror("epoll_ctl");
+            sessions[session->slot] = NULL;
+            sessionCount--;
+            close(fd);
+            freeSession(session);
+            continue;
+        }
+
+        sendAuthMenu(session);
+        flushSession(session);
+    }
+}
+
+// Handles readiness on one session socket: reads whatever has arrived, runs the state machine over
+// complete lines and flushes the replies. Never blocks, so one slow client cannot delay the rest.
+void serviceSession(Session *session, uint32_t events) {
+    if (events & EPOLLIN) {
+        for (;;) {
+            int space = sizeof(session->input) - session->inputLength;
+            if (space == 0) break; // Wait for the state machine to consume what is buffered
+            ssize_t n = read(session->fd, session->input + session->inputLength, space);
+            if (n > 0) {
+                session->inputLength += n;
+                session->lastActivity = time(NULL);
+                processSessionInput(session);
+                if (session->closed || session->closeAfterFlush) break;
+            } else if (n == 0) {
+                closeSession(session);
+                return;
+            } else {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    closeSession(session);
+                    return;
+                }
+                break;
+            }
+        }
+    } else if (events & (EPOLLERR | EPOLLHUP)) {
+        closeSession(session);
+        return;
+    }
+    flushSession(session);
+}
+
+// Closes sessions that have been silent for SESSION_IDLE_TIMEOUT_S, or whose pending output has not
+// drained for SESSION_WRITE_TIMEOUT_S.
+void closeIdleSessions(time_t now) {
+    for (int i = 0; i < MAX_SESSIONS && sessionCount > 0; i++) {
+        Session *session = sessions[i];
+        if (session != NULL && session->outputLength > 0 &&
+            now - session->outputStalledSince > SESSION_WRITE_TIMEOUT_S) {
+            closeSession(session); // Not reading, so a timeout notice would not get through either
+        } else if (session != NULL && session->state != SESSION_WAITING &&
+            now - session->lastActivity > SESSION_IDLE_TIMEOUT_S) {
+            sessionPrintf(session, "\nSession timed out.\n");
+            session->closeAfterFlush = 1;
+            if (!flushSession(session)) closeSession(session); // Do not wait on a client that is not reading
+        }
+    }
+}
+
+void stopServer(int signalNumber) {
+    (void)signalNumber;
+    serverStopping = 1;
+}
+
+// Lifts the open-file soft limit to the hard limit so the server can hold thousands of sockets.
+void raiseFileLimit() {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+// Serves login/signup and booking sessions for many clients on a local (Unix domain) socket from a
+// single thread. An epoll loop drives each client's state machine as its input arrives; completed
+// bookings, cancellations and reports go through the request scheduler like console actions do.
+int runSessionServer(Train trains[], const char *socketPath) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        printf("Socket path too long: %s\n", socketPath);
+        return 1;
+    }
+    strcpy(address.sun_path, socketPath);
+
+    raiseFileLimit();
+    int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        perror("socket");
+        return 1;
+    }
+    unlink(socketPath); // Remove a socket left behind by a previous run
+    if (bind(listenFd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(listenFd, SOMAXCONN) < 0) {
+        perror("Error binding session socket");
+        close(listenFd);
+        return 1;
+    }
+
+    serverEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event listenEvent = { .events = EPOLLIN, .data.ptr = NULL }; // NULL marks the listener
+    if (serverEpollFd < 0 || epoll_ctl(serverEpollFd, EPOLL_CTL_ADD, listenFd, &listenEvent) < 0) {
+        perror("epoll");
+        close(listenFd);
+        unlink(socketPath);
+        return 1;
+    }
+
+    struct sigaction stopAction;
+    memset(&stopAction, 0, sizeof(stopAction));
+    stopAction.sa_handler = stopServer;
+    sigaction(SIGINT, &stopAction, NULL);
+    sigaction(SIGTERM, &stopAction, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("Serving booking sessions on %s (Ctrl+C to stop).\n", socketPath);
+    struct epoll_event events[256];
+    time_t lastIdleCheck = time(NULL);
+
+    while (!serverStopping) {
+        // Don't sleep while the scheduler still has work queued from the last pass
+        int queued = 0;
+        for (int lane = 0; lane < LANE_COUNT; lane++) queued += requestQueues[lane].count;
+
+        int ready = epoll_wait(serverEpollFd, events, 256, queued > 0 ? 0 : 1000);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < ready; i++) {
+            if (events[i].data.ptr == NULL) {
+                acceptSessions(trains, listenFd);
+            } else {
+                serviceSession(events[i].data.ptr, events[i].events);
+            }
+        }
+
+        runScheduler(trains, SCHEDULER_TICK_BUDGET);
+        drainSeatFeed(trains);
+
+        time_t now = time(NULL);
+        if (now != lastIdleCheck) {
+            closeIdleSessions(now);
+            lastIdleCheck = now;
+        }
+    }
+
+    printf("\nStopping server with %d session(s) connected.\n", sessionCount);
+    while (runScheduler(trains, SCHEDULER_TICK_BUDGET) > 0) {} // Let queued bookings and cancellations finish
+    for (int i = 0; i < MAX_SESSIONS && sessionCount > 0; i++) {
+        if (sessions[i] != NULL) closeSession(sessions[i]);
+    }
+    drainSeatFeed(trains);
+    saveData(trains);
+
+    close(serverEpollFd);
+    close(listenFd);
+    unlink(socketPath);
+    return 0;
+}
+#endif
+
+// --- Data Persistence Functions ---
+
+// Flushes a data file written under a temporary name to disk and moves it over the real file, so
+// the real file always holds either the previous save or this one in full.
+int commitDataFile(FILE *fp, const char *tempPath, const char *path) {
+    int failed = fflush(fp) != 0 || fsync(fileno(fp)) != 0;
+    failed |= fclose(fp) != 0;
+    if (failed || rename(tempPath, path) != 0) {
+        perror(path);
+        remove(tempPath);
+        return 0;
+    }
+    return 1;
+}
+
+// Flushes the directory entries changed by the renames to disk. Without this a crash can bring back
+// the old files even though the new ones were synced.
+int syncDataDirectory() {
+    int fd = open(".", O_RDONLY | O_DIRECTORY);
+    if (fd < 0 || fsync(fd) != 0) {
+        perror("Error syncing data directory");
+        if (fd >= 0) close(fd);
+        return 0;
+    }
+    close(fd);
+    return 1;
+}
+
+// Saves train and user data to files, as the console and the server do when they stop.
+int saveData(Train trains[]) {
+    int saved = saveTrainData(trains);
+    saved = saveUserData() && saved;
+    if (saved) printf("Data saved successfully!\n");
+    return saved;
+}
+
+// Replaces train_data.txt with the current seats. The file is replaced in one step, so a booking
+// (even one spanning several trains) is either wholly in it or not at all. Returns 1 once the new
+// file is in place, so callers only undo a change that really did not reach the file; a failed
+// directory sync is reported but cannot take the renamed file back.
+int saveTrainData(Train trains[]) {
+    FILE *train_fp = fopen("train_data.txt.tmp", "w");
+    if (train_fp == NULL) {
+        perror("Error opening train_data.txt.tmp for writing");
+        return 0;
+    }
+
+    for (int i = 0; i < TRAINS; i++) {
+        fprintf(train_fp, "%s|%s\n", trains[i].trainName, trains[i].route);
+        for (int c = 0; c < CLASSES; c++) {
+            fprintf(train_fp, "%s|%d\n", trains[i].classes[c].className, trains[i].classes[c].fare);
+            for (int s = 0; s < trains[i].classes[c].layout->seatCount; s++) {
+                fprintf(train_fp, "%d,%d,%s\n",
+                        trains[i].classes[c].seats[s].seatNumber,
+                        trains[i].classes[c].seats[s].isReserved,
+                        trains[i].classes[c].seats[s].passengerName);
+            }
+        }
+    }
+
+    if (!commitDataFile(train_fp, "train_data.txt.tmp", "train_data.txt")) return 0;
+    syncDataDirectory();
+    return 1;
+}
+
+// Replaces user_data.txt with the registered users. Only sign-up and shutdown call this, so a
+// booking costs one file sync. Returns 1 once the new file is in place, like saveTrainData.
+int saveUserData() {
+    FILE *user_fp = fopen("user_data.txt.tmp", "w");
+    if (user_fp == NULL) {
+        perror("Error opening user_data.txt.tmp for writing");
+        return 0;
+    }
+
+    fprintf(user_fp, "%d\n", userCount); // First, save the number of users
+    for (int i = 0; i < userCount; i++) {
+        fprintf(user_fp, "%s\n", users[i].username);
+        fprintf(user_fp, "%s\n", users[i].password_hash);
+    }
+
+    if (!commitDataFile(user_fp, "user_data.txt.tmp", "user_data.txt")) return 0;
+    syncDataDirectory();
+    return 1;
+}
+
+// Reads the next line of a data file into 'line' without its newline, or leaves the line read ahead
+// by the previous call in place when *pending is set. Returns 0 at end of file.
+int readDataLine(FILE *fp, char *line, int size, int *pending) {
+    if (*pending) {
+        *pending = 0;
+        return 1;
+    }
+    if (fgets(line, size, fp) == NULL) return 0;
+    line[strcspn(line, "\n")] = '\0';
+    return 1;
+}
+
+// Tells seat lines ("<seat>,<reserved>,<passenger>") from train and class headers by their shape:
+// a seat line starts with its number and a comma. Passenger names may hold any character, '|'
+// included, so looking for the header separator is not enough.
+int isSeatLine(const char *line) {
+    if (!isdigit((unsigned char)line[0])) return 0;
+    while (isdigit((unsigned char)*line)) line++;
+    return *line == ',';
+}
+
+// Loads train and user data from files. Returns 0, after saying why, if train_data.txt is not in
+// a layout this version can read.
+int loadData(Train trains[]) {
+    for (int i = 0; i < TRAINS; i++) {
+        for (int c = 0; c < CLASSES; c++) {
+            trains[i].classes[c].layout = coachLayoutFor(i, c);
+        }
+    }
+
+    FILE *train_fp = fopen("train_data.txt", "r");
+    FILE *user_fp = fopen("user_data.txt", "r");
+
+    if (train_fp == NULL || user_fp == NULL) {
+        printf("No saved data found. Initializing new data.\n");
+        initializeTrains(trains, TRAINS); // Initialize trains with default empty state
+        userCount = 0; // Ensure userCount is 0 if no user data file found
+        if (train_fp) fclose(train_fp); // Close if one was opened but not the other
+        if (user_fp) fclose(user_fp);
+        return 1;
+    }
+
+    // Load user data
+    if (fscanf(user_fp, "%d\n", &userCount) != 1) { // Read the number of users first
+        printf("Error reading user count. User data might be corrupted. Resetting user data.\n");
+        userCount = 0; // Reset user count if read fails
+    } else {
+        if (userCount > MAX_USERS) { // Prevent buffer overflow if file has too many users
+            printf("Warning: Too many users in file, limiting to MAX_USERS (%d).\n", MAX_USERS);
+            userCount = MAX_USERS;
+        }
+        for (int i = 0; i < userCount; i++) {
+            if (fgets(users[i].username, sizeof(users[i].username), user_fp) != NULL) {
+                users[i].username[strcspn(users[i].username, "\n")] = '\0';
+            } else {
+                printf("Error reading username for user %d. User data might be corrupted. Stopping user load.\n", i);
+                userCount = i; // Adjust user count to reflect loaded users
+                break;
+            }
+            if (fgets(users[i].password_hash, sizeof(users[i].password_hash), user_fp) != NULL) {
+                users[i].password_hash[strcspn(users[i].password_hash, "\n")] = '\0';
+            } else {
+                printf("Error reading password hash for user %d. User data might be corrupted. Stopping user load.\n", i);
+                userCount = i; // Adjust user count
+                break;
+            }
+        }
+    }
+
+
+    // Load train data (similar logic as before). Each class stores one line per seat of its coach layout.
+    // Older files have smaller coaches (20 seats per class before the coach layouts, 46-berth 2nd AC on
+    // the LHB trains): a header turning up before all of a layout's seats were read marks such a class,
+    // and the seats it lacks are loaded as free. Lines that fit no layout stop the load, so a later save
+    // cannot overwrite the file with garbage.
     char line[300];
+    int pendingLine = 0; // 'line' holds a header read ahead while looking for more seats
+    int migrated = 0;
 
     for (int i = 0; i < TRAINS; i++) {
-        if (fgets(line, sizeof(line), train_fp) != NULL) {
-            line[strcspn(line, "\n")] = '\0';
+        if (readDataLine(train_fp, line, sizeof(line), &pendingLine)) {
+            if (strchr(line, '|') == NULL) {
+                printf("Unrecognized train line '%s' in train_data.txt. Fix or remove the file.\n", line);
+                fclose(train_fp);
+                fclose(user_fp);
+                return 0;
+            }
             char *token = strtok(line, "|");
             if (token != NULL) {
                 strcpy(trains[i].trainName, token);
@@ -641,57 +2214,76 @@ void loadData(Train trains[]) {
         }
 
         for (int c = 0; c < CLASSES; c++) {
-            if (fgets(line, sizeof(line), train_fp) != NULL) {
-                line[strcspn(line, "\n")] = '\0';
-                char *token = strtok(line, "|");
-                if (token != NULL) {
-                    strcpy(trains[i].classes[c].className, token);
-                    token = strtok(NULL, "|");
-                    if (token != NULL) {
-                        trains[i].classes[c].fare = atoi(token);
-                    }
+            TrainClass *trainClass = &trains[i].classes[c];
+            for (int s = 0; s < trainClass->layout->seatCount; s++) { // Seats missing from the file stay free
+                trainClass->seats[s].seatNumber = s + 1;
+                trainClass->seats[s].isReserved = 0;
+                trainClass->seats[s].passengerName[0] = '\0';
+            }
+
+            if (readDataLine(train_fp, line, sizeof(line), &pendingLine)) {
+                char *fare = strchr(line, '|');
+                int nameLength = fare == NULL ? 0 : fare - line;
+                if (nameLength == 0 || nameLength >= (int)sizeof(trainClass->className) ||
+                    !parseNumber(fare + 1, &trainClass->fare)) {
+                    printf("Unrecognized class line '%s' for train %d in train_data.txt. Fix or remove the file.\n", line, i);
+                    fclose(train_fp);
+                    fclose(user_fp);
+                    return 0;
                 }
+                memcpy(trainClass->className, line, nameLength);
+                trainClass->className[nameLength] = '\0';
             } else {
                 printf("Error reading class name/fare for train %d. Data might be corrupted.\n", i);
                 break;
             }
 
-            for (int s = 0; s < SEATS_PER_CLASS; s++) {
-                if (fgets(line, sizeof(line), train_fp) != NULL) {
-                    line[strcspn(line, "\n")] = '\0';
-                    char *token = strtok(line, ",");
-                    if (token != NULL) {
-                        trains[i].classes[c].seats[s].seatNumber = atoi(token);
-                        token = strtok(NULL, ",");
-                        if (token != NULL) {
-                            trains[i].classes[c].seats[s].isReserved = atoi(token);
-                            token = strtok(NULL, ",");
-                            if (token != NULL) {
-                                strcpy(trains[i].classes[c].seats[s].passengerName, token);
-                            } else {
-                                trains[i].classes[c].seats[s].passengerName[0] = '\0';
-                            }
-                        } else {
-                            trains[i].classes[c].seats[s].passengerName[0] = '\0';
-                        }
+            for (int s = 0; s < trainClass->layout->seatCount; s++) {
+                if (!readDataLine(train_fp, line, sizeof(line), &pendingLine)) {
+                    if (i == TRAINS - 1 && c == CLASSES - 1 && s > 0) { // The file ends with a smaller coach
+                        migrated = 1;
+                        break;
                     }
-                } else {
                     printf("Error reading seat data for train %d, class %d. Data might be corrupted.\n", i, c);
                     break;
                 }
+                if (!isSeatLine(line)) { // Next header: this class was saved with fewer seats
+                    pendingLine = 1;
+                    migrated = 1;
+                    break;
+                }
+
+                char *field;
+                if (strtol(line, &field, 10) != s + 1) {
+                    printf("Unexpected seat line for train %d, class %d, seat %d in train_data.txt. "
+                           "Fix or remove the file.\n", i, c, s + 1);
+                    fclose(train_fp);
+                    fclose(user_fp);
+                    return 0;
+                }
+                trainClass->seats[s].isReserved = strtol(field + 1, &field, 10);
+                if (*field == ',') { // The name is the rest of the line, so it may hold ',' or '|' too
+                    snprintf(trainClass->seats[s].passengerName, sizeof(trainClass->seats[s].passengerName), "%s", field + 1);
+                }
             }
         }
     }
 
+    rebuildAvailability(trains, TRAINS); // Seat states changed in bulk, so recount once
+
     fclose(train_fp);
     fclose(user_fp);
+    if (migrated) {
+        printf("Train data was saved with smaller coaches; seats added by the current coach layouts are free.\n");
+    }
     printf("Data loaded successfully!\n");
+    return 1;
 }
 
 
 // --- Main Function ---
 
-int main() {
+int main(int argc, char *argv[]) {
     // Initialize static train properties (names, routes).
     // Seat reservations and class fares/names will be loaded or default.
     Train trains[TRAINS] = {
@@ -718,70 +2310,27 @@ int main() {
     };
 
     // Load data at the start of the program
-    loadData(trains);
-
-    // Authentication loop
-    int auth_successful = 0;
-    while (!auth_successful) {
-        int choice;
-        showLoginSignupMenu();
-        if (scanf("%d", &choice) != 1) {
-            printf("Invalid input. Please enter a number.\n");
-            flushInput();
-            continue;
-        }
-        flushInput();
+    if (!loadData(trains)) {
+        return 1; // Nothing was saved, so the unreadable file is left as it is
+    }
 
-        switch (choice) {
-            case 1: // Login
-                auth_successful = login();
-                break;
-            case 2: // Sign Up
-                if (signup()) { // If signup was successful (new user added)
-                   saveData(trains); // Save user data (and train data, though train data is unchanged)
-                }
-                break;
-            case 3: // Exit from pre-login menu
-                printf("Exiting Train Reservation System. Goodbye!\n");
-                return 0;
-            default:
-                printf("Invalid choice. Please enter 1, 2, or 3.\n");
-                break;
-        }
+    // "--serve [socket path]" serves many clients over a local socket instead of this console
+    if (argc > 1 && strcmp(argv[1], "--serve") == 0) {
+#ifdef __linux__
+        return runSessionServer(trains, argc > 2 ? argv[2] : "trs.sock");
+#else
+        printf("--serve is not available on this platform; it needs Linux (epoll).\n");
+        return 1;
+#endif
     }
 
-    // Main application loop (after successful login)
-    int choice;
-    do {
-        showMenu();
-        if (scanf("%d", &choice) != 1) {
-            printf("Invalid input. Please enter a number.\n");
-            flushInput();
-            continue;
-        }
-        flushInput();
+    // Login/signup and the main menu run on the same session dialogs the socket server uses
+    runConsoleSession(trains);
+    saveData(trains); // Save all data before exiting
+    drainSeatFeed(trains);
 
-        switch (choice) {
-            case 1:
-                reserveSeat(trains);
-                break;
-            case 2:
-                cancelReservation(trains);
-                break;
-            case 3:
-                displaySeatChart(trains);
-                break;
-            case 4:
-                displayReservedSeats(trains);
-                break;
-            case 5:
-                printf("Exiting Train Reservation System. Bye!\n");
-                saveData(trains); // Save all data before exiting the main loop
-                break;
-            default:
-                printf("Invalid choice. Please enter a number between 1 and 5.\n");
-        }
-    } while (choice != 5);
+    printf("Seat feed: %lu event(s) published, %lu delivered, %lu dropped.\n",
+           atomic_load(&seatFeed.published), seatFeed.delivered, atomic_load(&seatFeed.dropped));
 
     return 0;
 }
\ No newline at end of file